@@ -0,0 +1,17 @@
+// per-frame camera state, see gps::CameraBlock
+layout (std140) uniform CameraBlock {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
+// per-frame light state, see gps::LightBlock
+layout (std140) uniform LightBlock {
+    mat4 lightSpaceMatrix;
+    vec3 lightPos;
+    vec3 lightDir;
+    vec3 lightColor;
+    float constant;
+    float linear_;
+    float quadratic;
+};
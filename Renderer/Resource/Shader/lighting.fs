@@ -0,0 +1,90 @@
+#version 410 core
+
+// uber-shader, the permutations are built by gps::ShaderVariants
+// (SHADOWS, FOG, POINT_LIGHT, INSTANCED, QUANTIZED_VERTS)
+
+out vec4 FragColor;
+
+in VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoords;
+#ifdef SHADOWS
+    vec4 FragPosLightSpace;
+#endif
+} fs_in;
+
+uniform sampler2D diffuseTexture;
+#ifdef SHADOWS
+uniform sampler2D shadowMap;
+#endif
+
+#include "frame_blocks.glsl"
+
+#ifdef FOG
+float computeFog()
+{
+    float fogDensity = 0.05f;
+    float fragmentDistance = length(fs_in.FragPos);
+    float fogFactor = exp(-pow(fragmentDistance * fogDensity, 2));
+
+    return clamp(fogFactor, 0.0f, 1.0f);
+}
+#endif
+
+#ifdef SHADOWS
+float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 toLight)
+{
+    // perform perspective divide
+    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+    // transform to [0,1] range
+    projCoords = projCoords * 0.5 + 0.5;
+    // fragments beyond the light's far plane are never in shadow
+    if (projCoords.z > 1.0)
+        return 0.0;
+
+    // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
+    float closestDepth = texture(shadowMap, projCoords.xy).r;
+    // get depth of current fragment from light's perspective
+    float currentDepth = projCoords.z;
+    // check whether current frag pos is in shadow
+    float bias = max(0.05 * (1.0 - dot(normal, toLight)), 0.005);
+    return currentDepth - bias > closestDepth ? 1.0 : 0.0;
+}
+#endif
+
+void main()
+{
+    vec3 color = texture(diffuseTexture, fs_in.TexCoords).rgb;
+    vec3 normal = normalize(fs_in.Normal);
+    // the scene is lit dimmer than LightBlock's color
+    vec3 intensity = vec3(0.3);
+    // ambient
+    vec3 ambient = 0.3 * intensity;
+    // diffuse
+#ifdef POINT_LIGHT
+    vec3 toLight = normalize(lightPos - fs_in.FragPos);
+#else
+    vec3 toLight = normalize(lightDir);
+#endif
+    float diff = max(dot(toLight, normal), 0.0);
+    vec3 diffuse = diff * intensity;
+    // specular
+    vec3 viewDir = normalize(viewPos - fs_in.FragPos);
+    vec3 halfwayDir = normalize(toLight + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), 64.0);
+    vec3 specular = spec * intensity;
+
+#ifdef SHADOWS
+    float shadow = ShadowCalculation(fs_in.FragPosLightSpace, normal, toLight);
+#else
+    float shadow = 0.0;
+#endif
+    vec3 lighting = (ambient + (1.0 - shadow) * (diffuse + specular)) * color;
+    FragColor = vec4(lighting, 1.0);
+
+#ifdef FOG
+    vec4 fogColor = vec4(0.5f, 0.5f, 0.5f, 1.0f);
+    FragColor = mix(fogColor, FragColor, computeFog());
+#endif
+}
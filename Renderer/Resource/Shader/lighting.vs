@@ -0,0 +1,49 @@
+#version 410 core
+
+// uber-shader, the permutations are built by gps::ShaderVariants
+// (SHADOWS, FOG, POINT_LIGHT, INSTANCED, QUANTIZED_VERTS)
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+#ifdef INSTANCED
+// per-instance transforms of instanced and batched draws, see gps::InstanceData
+layout (location = 3) in mat4 instanceModel;
+layout (location = 7) in mat3 instanceNormalMatrix;
+uniform bool instancedTransforms;
+#endif
+
+out VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoords;
+#ifdef SHADOWS
+    vec4 FragPosLightSpace;
+#endif
+} vs_out;
+
+uniform mat4 model;
+// inverse transpose of mat3(model), computed once per object on the CPU
+uniform mat3 normalMatrix;
+
+#include "frame_blocks.glsl"
+#include "vertex_decoding.glsl"
+
+void main()
+{
+#ifdef INSTANCED
+    mat4 modelMatrix = instancedTransforms ? instanceModel : model;
+    mat3 normalTransform = instancedTransforms ? instanceNormalMatrix : normalMatrix;
+#else
+    mat4 modelMatrix = model;
+    mat3 normalTransform = normalMatrix;
+#endif
+    vec3 position = decodePosition(aPos);
+    vs_out.FragPos = vec3(modelMatrix * vec4(position, 1.0));
+    vs_out.Normal = normalTransform * decodeNormal(aNormal);
+    vs_out.TexCoords = aTexCoords;
+#ifdef SHADOWS
+    vs_out.FragPosLightSpace = lightSpaceMatrix * vec4(vs_out.FragPos, 1.0);
+#endif
+    gl_Position = projection * view * modelMatrix * vec4(position, 1.0);
+}
@@ -1,11 +1,20 @@
 #version 410 core
 
 layout (location = 0) in vec3 aPos;
+// per-instance model matrix of instanced and batched draws, see gps::InstanceData
+layout (location = 3) in mat4 instanceModel;
 
-uniform mat4 lightSpaceMatrix;
 uniform mat4 model;
+uniform bool instancedTransforms;
+
+#include "frame_blocks.glsl"
+
+// drawn with quantized and float vertices alike
+#define QUANTIZED_VERTS
+#include "vertex_decoding.glsl"
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    mat4 modelMatrix = instancedTransforms ? instanceModel : model;
+    gl_Position = lightSpaceMatrix * modelMatrix * vec4(decodePosition(aPos), 1.0);
 }  
\ No newline at end of file
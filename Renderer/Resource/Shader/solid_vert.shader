@@ -9,13 +9,18 @@ out vec3 fNormal;
 out vec2 fTexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+#include "frame_blocks.glsl"
+
+// drawn with quantized and float vertices alike
+#define QUANTIZED_VERTS
+#include "vertex_decoding.glsl"
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
-	fPosition = vPosition;
-	fNormal = vNormal;
+	vec3 position = decodePosition(vPosition);
+	gl_Position = projection * view * model * vec4(position, 1.0f);
+	fPosition = position;
+	fNormal = decodeNormal(vNormal);
 	fTexCoords = vTexCoords;
 }
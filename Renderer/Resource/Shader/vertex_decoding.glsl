@@ -0,0 +1,33 @@
+// vertex decoding, see gps::VertexFormat
+#ifdef QUANTIZED_VERTS
+uniform bool quantizedVertices;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+vec3 decodePosition(vec3 position)
+{
+    return quantizedVertices ? positionOffset + position * positionScale : position;
+}
+
+vec3 decodeNormal(vec3 normal)
+{
+    if (!quantizedVertices)
+        return normal;
+    // octahedral encoding, only xy are supplied
+    vec3 n = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+#else
+// full float vertices only
+vec3 decodePosition(vec3 position)
+{
+    return position;
+}
+
+vec3 decodeNormal(vec3 normal)
+{
+    return normal;
+}
+#endif
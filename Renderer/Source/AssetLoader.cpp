@@ -0,0 +1,162 @@
+#include "AssetLoader.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <memory>
+
+namespace gps {
+
+    namespace {
+
+        // Shared by the jobs of one model, the last texture decode hands it to the main thread
+        struct ModelRequest
+        {
+            Model3D* model;
+            std::string fileName;
+            std::string basePath;
+            std::vector<MeshData> meshData;
+            // full texture path -> pixels, keys inserted before any decode job starts
+            std::map<std::string, Image> images;
+            std::atomic<int> remainingImages;
+        };
+    }
+
+    AssetLoader::AssetLoader()
+        : textureUploader(NULL), pendingCount(0)
+    {
+    }
+
+    AssetLoader::~AssetLoader()
+    {
+        Stop();
+    }
+
+    void AssetLoader::Start(unsigned workerCount)
+    {
+        pool.Start(workerCount);
+    }
+
+    void AssetLoader::Stop()
+    {
+        pool.Stop();
+        std::lock_guard<std::mutex> lock(mutex);
+        uploads.clear();
+        pendingCount = 0;
+    }
+
+    void AssetLoader::setTextureUploader(TextureUploader* uploader)
+    {
+        textureUploader = uploader;
+    }
+
+    void AssetLoader::LoadModel(Model3D& model, const std::string& fileName)
+    {
+        std::shared_ptr<ModelRequest> request = std::make_shared<ModelRequest>();
+        request->model = &model;
+        request->fileName = fileName;
+        request->basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+        pendingCount++;
+
+        pool.submit([this, request]() {
+            // the main thread reports the failure and leaves the model empty
+            if (!Model3D::ReadModelData(request->fileName, request->basePath, request->meshData)) {
+                queueUpload([request]() {
+                    std::cerr << "ERROR: could not load " << request->fileName << std::endl;
+                });
+                return;
+            }
+
+            for (size_t m = 0; m < request->meshData.size(); m++) {
+                const std::vector<TextureRef>& textures = request->meshData[m].textures;
+                for (size_t t = 0; t < textures.size(); t++)
+                    request->images[request->basePath + textures[t].path];
+            }
+
+            TextureUploader* uploader = textureUploader;
+            std::function<void()> upload = [request, uploader]() {
+                request->model->BuildMeshes(request->meshData, request->basePath, &request->images, uploader);
+            };
+            if (request->images.empty()) {
+                queueUpload(upload);
+                return;
+            }
+
+            // every texture decodes as its own job, so a model's textures load in parallel
+            request->remainingImages = (int)request->images.size();
+            for (std::map<std::string, Image>::iterator it = request->images.begin(); it != request->images.end(); ++it) {
+                const std::string* path = &it->first;
+                Image* image = &it->second;
+                pool.submit([this, request, path, image, upload, uploader]() {
+                    // streamed textures bring their mip chain instead of building it on the GPU
+                    if (Model3D::ReadTextureImage(*path, *image) && uploader)
+                        image->GenerateMipmaps();
+                    if (--request->remainingImages == 0)
+                        queueUpload(upload);
+                });
+            }
+        });
+    }
+
+    void AssetLoader::LoadImage(const std::string& fileName, int channels, bool generateMipmaps, const std::function<void(Image&)>& onReady)
+    {
+        std::shared_ptr<Image> image = std::make_shared<Image>();
+        pendingCount++;
+
+        pool.submit([this, image, fileName, channels, generateMipmaps, onReady]() {
+            // cooked blocks are used as they are, whatever channel count was asked for
+            bool cooked = TextureCache::Read(fileName, *image) &&
+                TextureUploader::SupportsCompression(image->getCompression());
+            if (!cooked) {
+                if (image->Load(fileName, channels, true)) {
+                    if (generateMipmaps)
+                        image->GenerateMipmaps();
+                } else {
+                    std::cerr << "ERROR: could not load " << fileName << std::endl;
+                }
+            }
+            queueUpload([image, onReady]() {
+                onReady(*image);
+            });
+        });
+    }
+
+    void AssetLoader::queueUpload(const std::function<void()>& upload)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            uploads.push_back(upload);
+        }
+        uploadReady.notify_one();
+    }
+
+    size_t AssetLoader::update()
+    {
+        std::vector<std::function<void()> > ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.swap(uploads);
+        }
+
+        for (size_t i = 0; i < ready.size(); i++)
+            ready[i]();
+        pendingCount -= ready.size();
+        return ready.size();
+    }
+
+    void AssetLoader::finish()
+    {
+        while (pendingCount > 0) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                uploadReady.wait(lock, [this] { return !uploads.empty(); });
+            }
+            update();
+        }
+    }
+
+    size_t AssetLoader::getPendingCount() const
+    {
+        return pendingCount;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef AssetLoader_hpp
+#define AssetLoader_hpp
+
+#include "Image.hpp"
+#include "Model3D.hpp"
+#include "TextureUploader.hpp"
+#include "ThreadPool.hpp"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Loads assets on a worker pool: file reads, .obj parsing and image decoding run on
+    // the workers, and only the GL upload of each finished asset runs on the main thread
+    // inside update(). Models stay empty and draw nothing until they are uploaded.
+    class AssetLoader
+    {
+    public:
+        AssetLoader();
+        ~AssetLoader();
+        AssetLoader(const AssetLoader&) = delete;
+        AssetLoader& operator=(const AssetLoader&) = delete;
+
+        // 0 workers means one per hardware thread but the main one
+        void Start(unsigned workerCount = 0);
+        // Abandons unfinished requests, call before the targets are destroyed
+        void Stop();
+
+        // Model textures stream through the uploader once set, with mip chains built on the workers
+        void setTextureUploader(TextureUploader* uploader);
+
+        // The model must outlive the request, its vertex format is read at upload time.
+        // A model that cannot be read is reported by update() and stays empty.
+        void LoadModel(Model3D& model, const std::string& fileName);
+        // onReady runs on the main thread with the image rows bottom first, unloaded if decoding
+        // failed. A cooked TextureCache is used instead of the file when the GL can sample it.
+        void LoadImage(const std::string& fileName, int channels, bool generateMipmaps, const std::function<void(Image&)>& onReady);
+
+        // Uploads the assets finished since the last call, returns how many there were
+        size_t update();
+        // Blocks until every request has been uploaded
+        void finish();
+        size_t getPendingCount() const;
+
+    private:
+        ThreadPool pool;
+        TextureUploader* textureUploader;
+        std::mutex mutex;
+        std::condition_variable uploadReady;
+        // main thread steps of finished requests, run by update()
+        std::vector<std::function<void()> > uploads;
+        // requested and not yet uploaded, only touched on the main thread
+        size_t pendingCount;
+
+        void queueUpload(const std::function<void()>& upload);
+    };
+}
+
+#endif /* AssetLoader_hpp */
@@ -0,0 +1,146 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    Benchmark::Benchmark(const std::vector<std::string>& passNames, int frameCount)
+    {
+        this->passNames = passNames;
+        this->frameCount = frameCount;
+        this->currentFrame = 0;
+
+        gpuQueries.resize(frameCount * passNames.size());
+        glGenQueries((GLsizei)gpuQueries.size(), gpuQueries.data());
+
+        cpuPassTimes.resize(gpuQueries.size(), 0.0);
+        frameTimes.reserve(frameCount);
+    }
+
+    Benchmark::~Benchmark()
+    {
+        glDeleteQueries((GLsizei)gpuQueries.size(), gpuQueries.data());
+    }
+
+    void Benchmark::beginFrame()
+    {
+        frameStart = Clock::now();
+    }
+
+    void Benchmark::endFrame()
+    {
+        std::chrono::duration<double, std::milli> elapsed = Clock::now() - frameStart;
+        frameTimes.push_back(elapsed.count());
+        currentFrame++;
+    }
+
+    void Benchmark::beginPass(int pass)
+    {
+        glBeginQuery(GL_TIME_ELAPSED, gpuQueries[currentFrame * passNames.size() + pass]);
+        passStart = Clock::now();
+    }
+
+    void Benchmark::endPass(int pass)
+    {
+        std::chrono::duration<double, std::milli> elapsed = Clock::now() - passStart;
+        cpuPassTimes[currentFrame * passNames.size() + pass] = elapsed.count();
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+
+    bool Benchmark::isFinished() const
+    {
+        return currentFrame >= frameCount;
+    }
+
+    int Benchmark::getFrameCount() const
+    {
+        return frameCount;
+    }
+
+    std::vector<double> Benchmark::collectGpuTimes(int pass)
+    {
+        std::vector<double> times;
+        for (int frame = 0; frame < currentFrame; frame++) {
+            GLuint64 elapsedNs = 0;
+            // blocks until the result is available, which is fine once the run is over
+            glGetQueryObjectui64v(gpuQueries[frame * passNames.size() + pass], GL_QUERY_RESULT, &elapsedNs);
+            times.push_back(elapsedNs / 1.0e6);
+        }
+        return times;
+    }
+
+    std::vector<double> Benchmark::collectCpuTimes(int pass)
+    {
+        std::vector<double> times;
+        for (int frame = 0; frame < currentFrame; frame++)
+            times.push_back(cpuPassTimes[frame * passNames.size() + pass]);
+        return times;
+    }
+
+    TimingStats Benchmark::computeStats(std::vector<double> samples)
+    {
+        TimingStats stats = { 0.0, 0.0, 0.0, 0.0 };
+        if (samples.empty())
+            return stats;
+
+        std::sort(samples.begin(), samples.end());
+        size_t count = samples.size();
+
+        stats.min = samples.front();
+        stats.median = (count % 2 == 1) ? samples[count / 2] : 0.5 * (samples[count / 2 - 1] + samples[count / 2]);
+        // nearest-rank percentile
+        size_t p99Rank = (size_t)std::ceil(0.99 * count);
+        stats.p99 = samples[std::max<size_t>(p99Rank, 1) - 1];
+
+        double sum = 0.0;
+        for (size_t i = 0; i < count; i++)
+            sum += samples[i];
+        stats.mean = sum / count;
+
+        return stats;
+    }
+
+    void Benchmark::writeStats(std::ostream& out, const TimingStats& stats)
+    {
+        out << "{ \"min\": " << stats.min
+            << ", \"median\": " << stats.median
+            << ", \"p99\": " << stats.p99
+            << ", \"mean\": " << stats.mean << " }";
+    }
+
+    void Benchmark::addCounter(const std::string& name, double perFrame)
+    {
+        counters.push_back(std::make_pair(name, perFrame));
+    }
+
+    void Benchmark::writeJSON(std::ostream& out, const std::string& renderer, int width, int height)
+    {
+        out << "{\n";
+        out << "  \"renderer\": \"" << renderer << "\",\n";
+        out << "  \"width\": " << width << ",\n";
+        out << "  \"height\": " << height << ",\n";
+        out << "  \"frames\": " << currentFrame << ",\n";
+        out << "  \"unit\": \"ms\",\n";
+        out << "  \"frame\": { \"cpu\": ";
+        writeStats(out, computeStats(frameTimes));
+        out << " },\n";
+        out << "  \"passes\": {\n";
+        for (size_t pass = 0; pass < passNames.size(); pass++) {
+            out << "    \"" << passNames[pass] << "\": {\n";
+            out << "      \"cpu\": ";
+            writeStats(out, computeStats(collectCpuTimes((int)pass)));
+            out << ",\n";
+            out << "      \"gpu\": ";
+            writeStats(out, computeStats(collectGpuTimes((int)pass)));
+            out << "\n    }" << (pass + 1 < passNames.size() ? "," : "") << "\n";
+        }
+        out << "  },\n";
+        out << "  \"counters\": {";
+        for (size_t i = 0; i < counters.size(); i++) {
+            out << (i ? ",\n" : "\n") << "    \"" << counters[i].first << "\": " << counters[i].second;
+        }
+        out << (counters.empty() ? "}\n" : "\n  }\n");
+        out << "}\n";
+    }
+}
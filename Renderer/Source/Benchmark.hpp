@@ -0,0 +1,71 @@
+#ifndef Benchmark_hpp
+#define Benchmark_hpp
+
+#include <GLEW/glew.h>
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gps {
+
+    // Min/median/p99 summary of a series of samples, in milliseconds
+    struct TimingStats {
+        double min;
+        double median;
+        double p99;
+        double mean;
+    };
+
+    // Collects per-pass CPU and GPU times over a fixed number of frames.
+    // GPU times come from GL_TIME_ELAPSED queries; one query object is allocated
+    // per pass per frame up front and only read back once the run is over, so
+    // timing never stalls the pipeline.
+    class Benchmark
+    {
+    public:
+        Benchmark(const std::vector<std::string>& passNames, int frameCount);
+        ~Benchmark();
+
+        void beginFrame();
+        void endFrame();
+
+        void beginPass(int pass);
+        void endPass(int pass);
+
+        bool isFinished() const;
+        int getFrameCount() const;
+
+        // Extra per-frame figure reported under "counters", e.g. GL calls issued
+        void addCounter(const std::string& name, double perFrame);
+
+        // Reads back all pending GPU queries and writes the report as JSON
+        void writeJSON(std::ostream& out, const std::string& renderer, int width, int height);
+
+        static TimingStats computeStats(std::vector<double> samples);
+
+    private:
+        typedef std::chrono::high_resolution_clock Clock;
+
+        std::vector<std::string> passNames;
+        int frameCount;
+        int currentFrame;
+
+        // [frame * passCount + pass]
+        std::vector<GLuint> gpuQueries;
+        std::vector<double> cpuPassTimes;
+        std::vector<double> frameTimes;
+        std::vector<std::pair<std::string, double> > counters;
+
+        Clock::time_point frameStart;
+        Clock::time_point passStart;
+
+        std::vector<double> collectGpuTimes(int pass);
+        std::vector<double> collectCpuTimes(int pass);
+        static void writeStats(std::ostream& out, const TimingStats& stats);
+    };
+}
+
+#endif /* Benchmark_hpp */
@@ -0,0 +1,235 @@
+#include "BlockCompression.hpp"
+
+#include <cstdint>
+
+namespace gps {
+
+    namespace {
+
+        const int BLOCK_TEXELS = 16;
+
+        // Copies the 4x4 block at (blockX, blockY) as RGBA, edges repeat the last row or column
+        void fetchBlock(const unsigned char* pixels, int width, int height, int channels,
+            int blockX, int blockY, unsigned char texels[BLOCK_TEXELS][4])
+        {
+            for (int y = 0; y < 4; y++) {
+                int row = blockY * 4 + y < height ? blockY * 4 + y : height - 1;
+                for (int x = 0; x < 4; x++) {
+                    int column = blockX * 4 + x < width ? blockX * 4 + x : width - 1;
+                    const unsigned char* source = pixels + ((size_t)row * width + column) * channels;
+                    unsigned char* texel = texels[y * 4 + x];
+                    for (int c = 0; c < 4; c++)
+                        texel[c] = c < channels ? source[c] : (c == 3 ? 255 : 0);
+                }
+            }
+        }
+
+        uint16_t packColor(const int color[3])
+        {
+            return (uint16_t)(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+        }
+
+        void unpackColor(uint16_t packed, int color[3])
+        {
+            int r = (packed >> 11) & 31;
+            int g = (packed >> 5) & 63;
+            int b = packed & 31;
+            color[0] = (r << 3) | (r >> 2);
+            color[1] = (g << 2) | (g >> 4);
+            color[2] = (b << 3) | (b >> 2);
+        }
+
+        // BC1 color block, always in four color mode so BC3 can share it
+        void encodeColorBlock(const unsigned char texels[BLOCK_TEXELS][4], unsigned char* block)
+        {
+            int lower[3] = { 255, 255, 255 };
+            int upper[3] = { 0, 0, 0 };
+            int mean[3] = { 0, 0, 0 };
+            for (int i = 0; i < BLOCK_TEXELS; i++) {
+                for (int c = 0; c < 3; c++) {
+                    if (texels[i][c] < lower[c])
+                        lower[c] = texels[i][c];
+                    if (texels[i][c] > upper[c])
+                        upper[c] = texels[i][c];
+                    mean[c] += texels[i][c];
+                }
+            }
+
+            // the box diagonal follows the channel with the widest range, a channel that
+            // falls while it rises runs the other way
+            int widest = 0;
+            for (int c = 1; c < 3; c++) {
+                if (upper[c] - lower[c] > upper[widest] - lower[widest])
+                    widest = c;
+            }
+            for (int c = 0; c < 3; c++) {
+                if (c == widest)
+                    continue;
+                int covariance = 0;
+                for (int i = 0; i < BLOCK_TEXELS; i++)
+                    covariance += (texels[i][c] * BLOCK_TEXELS - mean[c]) * (texels[i][widest] * BLOCK_TEXELS - mean[widest]) / 256;
+                if (covariance < 0)
+                    std::swap(lower[c], upper[c]);
+            }
+
+            // pull the ends in a little, they are rarely hit exactly
+            for (int c = 0; c < 3; c++) {
+                int inset = (upper[c] - lower[c]) / 16;
+                upper[c] -= inset;
+                lower[c] += inset;
+            }
+
+            uint16_t color0 = packColor(upper);
+            uint16_t color1 = packColor(lower);
+            if (color0 < color1)
+                std::swap(color0, color1);
+
+            uint32_t indices = 0;
+            if (color0 != color1) {
+                int palette[4][3];
+                unpackColor(color0, palette[0]);
+                unpackColor(color1, palette[1]);
+                for (int c = 0; c < 3; c++) {
+                    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+                }
+
+                for (int i = 0; i < BLOCK_TEXELS; i++) {
+                    int best = 0;
+                    int bestDistance = 0x7FFFFFFF;
+                    for (int p = 0; p < 4; p++) {
+                        int distance = 0;
+                        for (int c = 0; c < 3; c++) {
+                            int delta = texels[i][c] - palette[p][c];
+                            distance += delta * delta;
+                        }
+                        if (distance < bestDistance) {
+                            bestDistance = distance;
+                            best = p;
+                        }
+                    }
+                    indices |= (uint32_t)best << (2 * i);
+                }
+            }
+
+            block[0] = (unsigned char)(color0 & 0xFF);
+            block[1] = (unsigned char)(color0 >> 8);
+            block[2] = (unsigned char)(color1 & 0xFF);
+            block[3] = (unsigned char)(color1 >> 8);
+            for (int i = 0; i < 4; i++)
+                block[4 + i] = (unsigned char)(indices >> (8 * i));
+        }
+
+        // BC4 block of one channel, in eight value mode
+        void encodeChannelBlock(const unsigned char texels[BLOCK_TEXELS][4], int channel, unsigned char* block)
+        {
+            int lower = 255;
+            int upper = 0;
+            for (int i = 0; i < BLOCK_TEXELS; i++) {
+                if (texels[i][channel] < lower)
+                    lower = texels[i][channel];
+                if (texels[i][channel] > upper)
+                    upper = texels[i][channel];
+            }
+
+            uint64_t indices = 0;
+            if (upper != lower) {
+                int palette[8];
+                palette[0] = upper;
+                palette[1] = lower;
+                for (int p = 2; p < 8; p++)
+                    palette[p] = ((8 - p) * upper + (p - 1) * lower) / 7;
+
+                for (int i = 0; i < BLOCK_TEXELS; i++) {
+                    int best = 0;
+                    int bestDistance = 256;
+                    for (int p = 0; p < 8; p++) {
+                        int distance = texels[i][channel] - palette[p];
+                        distance = distance < 0 ? -distance : distance;
+                        if (distance < bestDistance) {
+                            bestDistance = distance;
+                            best = p;
+                        }
+                    }
+                    indices |= (uint64_t)best << (3 * i);
+                }
+            }
+
+            block[0] = (unsigned char)upper;
+            block[1] = (unsigned char)lower;
+            for (int i = 0; i < 6; i++)
+                block[2 + i] = (unsigned char)(indices >> (8 * i));
+        }
+    }
+
+    ImageCompression ChooseCompression(const Image& image)
+    {
+        if (image.getChannels() == 1)
+            return IMAGE_BC4;
+        if (image.getChannels() == 2)
+            return IMAGE_BC5;
+        if (image.getChannels() == 4) {
+            const Image::Level& level = image.getLevel(0);
+            const unsigned char* pixels = image.getLevelPixels(0);
+            for (size_t i = 3; i < level.size; i += 4) {
+                if (pixels[i] != 255)
+                    return IMAGE_BC3;
+            }
+        }
+        return IMAGE_BC1;
+    }
+
+    bool CompressImage(const Image& source, ImageCompression compression, Image& result)
+    {
+        int channels = source.getChannels();
+        if (!source.isLoaded() || source.getCompression() != IMAGE_UNCOMPRESSED || compression == IMAGE_UNCOMPRESSED ||
+            &source == &result) {
+            return false;
+        }
+        if ((compression == IMAGE_BC1 && channels < 3) || (compression == IMAGE_BC3 && channels < 4) ||
+            (compression == IMAGE_BC5 && channels < 2)) {
+            return false;
+        }
+
+        std::vector<Image::Level> levels(source.getLevelCount());
+        size_t total = 0;
+        for (size_t l = 0; l < levels.size(); l++) {
+            levels[l] = source.getLevel(l);
+            levels[l].offset = total;
+            levels[l].size = Image::LevelSize(levels[l].width, levels[l].height, channels, compression);
+            total += levels[l].size;
+        }
+
+        unsigned char* blocks = result.Allocate(levels, channels, compression);
+        if (!blocks)
+            return false;
+        size_t blockSize = Image::BlockSize(compression);
+        unsigned char texels[BLOCK_TEXELS][4];
+        for (size_t l = 0; l < levels.size(); l++) {
+            const Image::Level& level = levels[l];
+            const unsigned char* pixels = source.getLevelPixels(l);
+            unsigned char* block = blocks + level.offset;
+            int blocksX = (level.width + 3) / 4;
+            int blocksY = (level.height + 3) / 4;
+
+            for (int by = 0; by < blocksY; by++) {
+                for (int bx = 0; bx < blocksX; bx++) {
+                    fetchBlock(pixels, level.width, level.height, channels, bx, by, texels);
+                    if (compression == IMAGE_BC1) {
+                        encodeColorBlock(texels, block);
+                    } else if (compression == IMAGE_BC3) {
+                        encodeChannelBlock(texels, 3, block);
+                        encodeColorBlock(texels, block + 8);
+                    } else if (compression == IMAGE_BC4) {
+                        encodeChannelBlock(texels, 0, block);
+                    } else {
+                        encodeChannelBlock(texels, 0, block);
+                        encodeChannelBlock(texels, 1, block + 8);
+                    }
+                    block += blockSize;
+                }
+            }
+        }
+        return true;
+    }
+}
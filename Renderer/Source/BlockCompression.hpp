@@ -0,0 +1,19 @@
+#ifndef BlockCompression_hpp
+#define BlockCompression_hpp
+
+#include "Image.hpp"
+
+namespace gps {
+
+    // Smallest block format keeping the image's channels: BC4 for one, BC5 for two,
+    // BC1 for three or for four when every texel is opaque, BC3 otherwise
+    ImageCompression ChooseCompression(const Image& image);
+
+    // Compresses every level of uncompressed pixels into 4x4 blocks with a bounding box
+    // fit, meant for cooking textures offline. BC1 and BC3 read RGB(A), BC4 the first
+    // channel and BC5 the first two. False when the image does not have enough channels
+    // or result is the source itself.
+    bool CompressImage(const Image& source, ImageCompression compression, Image& result);
+}
+
+#endif /* BlockCompression_hpp */
@@ -0,0 +1,423 @@
+#include "Bvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace gps {
+
+    namespace {
+
+        // traversal step cost relative to one primitive test
+        const float TRAVERSAL_COST = 1.0f;
+
+        void growBox(Aabb& box, const Aabb& other)
+        {
+            box.lower = glm::min(box.lower, other.lower);
+            box.upper = glm::max(box.upper, other.upper);
+        }
+
+        Aabb emptyBox()
+        {
+            Aabb box;
+            box.lower = glm::vec3(std::numeric_limits<float>::max());
+            box.upper = glm::vec3(-std::numeric_limits<float>::max());
+            return box;
+        }
+
+        // half the surface area, the factor cancels out of every SAH ratio
+        float halfArea(const Aabb& box)
+        {
+            glm::vec3 size = box.upper - box.lower;
+            if (size.x < 0.0f)
+                return 0.0f;
+            return size.x * size.y + size.y * size.z + size.z * size.x;
+        }
+
+        float halfArea(const BvhNode& node)
+        {
+            Aabb box;
+            box.lower = node.lower;
+            box.upper = node.upper;
+            return halfArea(box);
+        }
+
+        // 0 outside, 1 straddling, 2 inside
+        int classifyBox(const glm::vec4& plane, const glm::vec3& lower, const glm::vec3& upper)
+        {
+            glm::vec3 center = (lower + upper) * 0.5f;
+            glm::vec3 extents = (upper - lower) * 0.5f;
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            float radius = glm::dot(glm::abs(glm::vec3(plane)), extents);
+            if (distance + radius < 0.0f)
+                return 0;
+            return distance - radius >= 0.0f ? 2 : 1;
+        }
+
+        // entry distance of the ray into the box, negative when it misses within maxDistance
+        float intersectBox(const glm::vec3& lower, const glm::vec3& upper, const glm::vec3& origin,
+            const glm::vec3& inverseDirection, float maxDistance)
+        {
+            glm::vec3 t0 = (lower - origin) * inverseDirection;
+            glm::vec3 t1 = (upper - origin) * inverseDirection;
+            glm::vec3 tNear = glm::min(t0, t1);
+            glm::vec3 tFar = glm::max(t0, t1);
+            float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+            float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+            return entry <= exit ? entry : -1.0f;
+        }
+    }
+
+    Bvh::Bvh()
+    {
+    }
+
+    void Bvh::build(const std::vector<Aabb>& boxes)
+    {
+        clear();
+        if (boxes.empty())
+            return;
+
+        std::vector<BuildPrimitive> primitives(boxes.size());
+        for (size_t i = 0; i < boxes.size(); i++) {
+            primitives[i].box = boxes[i];
+            primitives[i].centroid = (boxes[i].lower + boxes[i].upper) * 0.5f;
+            primitives[i].index = (uint32_t)i;
+        }
+
+        // a binary tree over n leaves never needs more than 2n - 1 nodes
+        nodes.reserve(boxes.size() * 2);
+        nodes.push_back(BvhNode());
+        buildNode(primitives, 0, 0, (uint32_t)primitives.size(), 0);
+
+        primitiveBoxes.resize(primitives.size());
+        primitiveIndices.resize(primitives.size());
+        for (size_t i = 0; i < primitives.size(); i++) {
+            primitiveBoxes[i] = primitives[i].box;
+            primitiveIndices[i] = primitives[i].index;
+        }
+    }
+
+    void Bvh::buildNode(std::vector<BuildPrimitive>& primitives, uint32_t nodeIndex, uint32_t first, uint32_t count, int depth)
+    {
+        Aabb bounds = emptyBox();
+        Aabb centroidBounds = emptyBox();
+        for (uint32_t i = first; i < first + count; i++) {
+            growBox(bounds, primitives[i].box);
+            centroidBounds.lower = glm::min(centroidBounds.lower, primitives[i].centroid);
+            centroidBounds.upper = glm::max(centroidBounds.upper, primitives[i].centroid);
+        }
+        nodes[nodeIndex].lower = bounds.lower;
+        nodes[nodeIndex].upper = bounds.upper;
+        nodes[nodeIndex].offset = first;
+        nodes[nodeIndex].count = count;
+
+        glm::vec3 centroidExtent = centroidBounds.upper - centroidBounds.lower;
+        int axis = 0;
+        if (centroidExtent.y > centroidExtent[axis])
+            axis = 1;
+        if (centroidExtent.z > centroidExtent[axis])
+            axis = 2;
+        // coincident centroids cannot be separated
+        if (count <= 1 || centroidExtent[axis] <= 0.0f)
+            return;
+
+        uint32_t leftCount = 0;
+        if (depth >= SAH_MAX_DEPTH) {
+            if (count <= MAX_LEAF_SIZE)
+                return;
+            leftCount = count / 2;
+            std::nth_element(primitives.begin() + first, primitives.begin() + first + leftCount,
+                primitives.begin() + first + count,
+                [axis](const BuildPrimitive& a, const BuildPrimitive& b) { return a.centroid[axis] < b.centroid[axis]; });
+        }
+        else {
+            float bestCost = std::numeric_limits<float>::max();
+            int bestAxis = -1;
+            int bestSplit = 0;
+
+            for (int candidate = 0; candidate < 3; candidate++) {
+                float extent = centroidExtent[candidate];
+                if (extent <= 0.0f)
+                    continue;
+
+                Aabb binBoxes[BIN_COUNT];
+                uint32_t binCounts[BIN_COUNT];
+                for (int bin = 0; bin < BIN_COUNT; bin++) {
+                    binBoxes[bin] = emptyBox();
+                    binCounts[bin] = 0;
+                }
+                float scale = BIN_COUNT / extent;
+                for (uint32_t i = first; i < first + count; i++) {
+                    int bin = std::min(BIN_COUNT - 1,
+                        (int)((primitives[i].centroid[candidate] - centroidBounds.lower[candidate]) * scale));
+                    growBox(binBoxes[bin], primitives[i].box);
+                    binCounts[bin]++;
+                }
+
+                // right side areas swept from the end, then the left side on the way forward
+                float rightAreas[BIN_COUNT];
+                uint32_t rightCounts[BIN_COUNT];
+                Aabb rightBox = emptyBox();
+                uint32_t rightCount = 0;
+                for (int bin = BIN_COUNT - 1; bin > 0; bin--) {
+                    growBox(rightBox, binBoxes[bin]);
+                    rightCount += binCounts[bin];
+                    rightAreas[bin] = halfArea(rightBox);
+                    rightCounts[bin] = rightCount;
+                }
+
+                Aabb leftBox = emptyBox();
+                uint32_t left = 0;
+                for (int split = 1; split < BIN_COUNT; split++) {
+                    growBox(leftBox, binBoxes[split - 1]);
+                    left += binCounts[split - 1];
+                    if (left == 0 || rightCounts[split] == 0)
+                        continue;
+                    float cost = halfArea(leftBox) * left + rightAreas[split] * rightCounts[split];
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = candidate;
+                        bestSplit = split;
+                    }
+                }
+            }
+
+            if (bestAxis < 0)
+                return;
+
+            // small nodes stay leaves unless splitting is cheaper than testing them all
+            float leafCost = (float)count;
+            float splitCost = TRAVERSAL_COST + bestCost / halfArea(bounds);
+            if (count <= MAX_LEAF_SIZE && leafCost <= splitCost)
+                return;
+
+            float lower = centroidBounds.lower[bestAxis];
+            float scale = BIN_COUNT / centroidExtent[bestAxis];
+            std::vector<BuildPrimitive>::iterator middle = std::partition(
+                primitives.begin() + first, primitives.begin() + first + count,
+                [=](const BuildPrimitive& primitive) {
+                    int bin = std::min(BIN_COUNT - 1, (int)((primitive.centroid[bestAxis] - lower) * scale));
+                    return bin < bestSplit;
+                });
+            leftCount = (uint32_t)(middle - (primitives.begin() + first));
+        }
+
+        uint32_t leftIndex = (uint32_t)nodes.size();
+        nodes.push_back(BvhNode());
+        buildNode(primitives, leftIndex, first, leftCount, depth + 1);
+
+        uint32_t rightIndex = (uint32_t)nodes.size();
+        nodes.push_back(BvhNode());
+        buildNode(primitives, rightIndex, first + leftCount, count - leftCount, depth + 1);
+
+        nodes[nodeIndex].offset = rightIndex;
+        nodes[nodeIndex].count = 0;
+    }
+
+    void Bvh::refit(const std::vector<Aabb>& boxes)
+    {
+        for (size_t i = 0; i < primitiveBoxes.size(); i++)
+            primitiveBoxes[i] = boxes[primitiveIndices[i]];
+
+        // children always follow their parent, so a reverse sweep sees them first
+        for (size_t i = nodes.size(); i-- > 0;) {
+            BvhNode& node = nodes[i];
+            Aabb bounds = emptyBox();
+            if (node.count > 0) {
+                for (uint32_t p = node.offset; p < node.offset + node.count; p++)
+                    growBox(bounds, primitiveBoxes[p]);
+            }
+            else {
+                const BvhNode& left = nodes[i + 1];
+                const BvhNode& right = nodes[node.offset];
+                bounds.lower = glm::min(left.lower, right.lower);
+                bounds.upper = glm::max(left.upper, right.upper);
+            }
+            node.lower = bounds.lower;
+            node.upper = bounds.upper;
+        }
+    }
+
+    void Bvh::clear()
+    {
+        nodes.clear();
+        primitiveBoxes.clear();
+        primitiveIndices.clear();
+    }
+
+    size_t Bvh::getPrimitiveCount() const
+    {
+        return primitiveIndices.size();
+    }
+
+    size_t Bvh::getNodeCount() const
+    {
+        return nodes.size();
+    }
+
+    float Bvh::getCost() const
+    {
+        if (nodes.empty())
+            return 0.0f;
+
+        float rootArea = halfArea(nodes[0]);
+        if (rootArea <= 0.0f)
+            return 0.0f;
+
+        float cost = 0.0f;
+        for (size_t i = 0; i < nodes.size(); i++) {
+            const BvhNode& node = nodes[i];
+            cost += halfArea(node) * (node.count > 0 ? (float)node.count : TRAVERSAL_COST);
+        }
+        return cost / rootArea;
+    }
+
+    size_t Bvh::acceptSubtree(uint32_t nodeIndex, std::vector<uint8_t>& visible) const
+    {
+        uint32_t leftmost = nodeIndex;
+        while (nodes[leftmost].count == 0)
+            leftmost++;
+        uint32_t rightmost = nodeIndex;
+        while (nodes[rightmost].count == 0)
+            rightmost = nodes[rightmost].offset;
+
+        uint32_t first = nodes[leftmost].offset;
+        uint32_t last = nodes[rightmost].offset + nodes[rightmost].count;
+        for (uint32_t p = first; p < last; p++)
+            visible[primitiveIndices[p]] = 1;
+        return last - first;
+    }
+
+    size_t Bvh::cull(const Frustum& frustum, std::vector<uint8_t>& visible) const
+    {
+        visible.assign(primitiveIndices.size(), 0);
+        if (nodes.empty())
+            return 0;
+
+        const unsigned ALL_PLANES = (1u << Frustum::PLANE_COUNT) - 1;
+        uint32_t stackNodes[STACK_SIZE];
+        unsigned stackMasks[STACK_SIZE];
+        int stackSize = 0;
+        stackNodes[stackSize] = 0;
+        stackMasks[stackSize] = ALL_PLANES;
+        stackSize++;
+
+        size_t visibleCount = 0;
+        while (stackSize > 0) {
+            stackSize--;
+            uint32_t nodeIndex = stackNodes[stackSize];
+            unsigned mask = stackMasks[stackSize];
+            const BvhNode& node = nodes[nodeIndex];
+
+            bool outside = false;
+            for (int p = 0; p < Frustum::PLANE_COUNT && !outside; p++) {
+                if (!(mask & (1u << p)))
+                    continue;
+                int side = classifyBox(frustum.planes[p], node.lower, node.upper);
+                if (side == 0)
+                    outside = true;
+                else if (side == 2)
+                    mask &= ~(1u << p);
+            }
+            if (outside)
+                continue;
+
+            if (mask == 0) {
+                visibleCount += acceptSubtree(nodeIndex, visible);
+                continue;
+            }
+
+            if (node.count > 0) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                    const Aabb& box = primitiveBoxes[i];
+                    bool inside = true;
+                    for (int p = 0; p < Frustum::PLANE_COUNT && inside; p++) {
+                        if ((mask & (1u << p)) && classifyBox(frustum.planes[p], box.lower, box.upper) == 0)
+                            inside = false;
+                    }
+                    if (inside) {
+                        visible[primitiveIndices[i]] = 1;
+                        visibleCount++;
+                    }
+                }
+                continue;
+            }
+
+            stackNodes[stackSize] = node.offset;
+            stackMasks[stackSize] = mask;
+            stackSize++;
+            stackNodes[stackSize] = nodeIndex + 1;
+            stackMasks[stackSize] = mask;
+            stackSize++;
+        }
+        return visibleCount;
+    }
+
+    bool Bvh::intersectRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+        uint32_t& primitive, float& distance) const
+    {
+        if (nodes.empty())
+            return false;
+
+        glm::vec3 inverseDirection = 1.0f / direction;
+        float nearest = maxDistance;
+        bool hit = false;
+
+        uint32_t stackNodes[STACK_SIZE];
+        float stackDistances[STACK_SIZE];
+        int stackSize = 0;
+
+        float rootEntry = intersectBox(nodes[0].lower, nodes[0].upper, origin, inverseDirection, nearest);
+        if (rootEntry < 0.0f)
+            return false;
+        stackNodes[stackSize] = 0;
+        stackDistances[stackSize] = rootEntry;
+        stackSize++;
+
+        while (stackSize > 0) {
+            stackSize--;
+            // a closer hit may have been found since this node was pushed
+            if (stackDistances[stackSize] > nearest)
+                continue;
+            const BvhNode& node = nodes[stackNodes[stackSize]];
+
+            if (node.count > 0) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                    float entry = intersectBox(primitiveBoxes[i].lower, primitiveBoxes[i].upper, origin, inverseDirection, nearest);
+                    if (entry >= 0.0f && entry < nearest) {
+                        nearest = entry;
+                        primitive = primitiveIndices[i];
+                        hit = true;
+                    }
+                }
+                continue;
+            }
+
+            uint32_t nearChild = stackNodes[stackSize] + 1;
+            uint32_t farChild = node.offset;
+            float nearEntry = intersectBox(nodes[nearChild].lower, nodes[nearChild].upper, origin, inverseDirection, nearest);
+            float farEntry = intersectBox(nodes[farChild].lower, nodes[farChild].upper, origin, inverseDirection, nearest);
+            if (farEntry >= 0.0f && (nearEntry < 0.0f || farEntry < nearEntry)) {
+                std::swap(nearChild, farChild);
+                std::swap(nearEntry, farEntry);
+            }
+
+            // the nearer child is pushed last so it is visited first
+            if (farEntry >= 0.0f) {
+                stackNodes[stackSize] = farChild;
+                stackDistances[stackSize] = farEntry;
+                stackSize++;
+            }
+            if (nearEntry >= 0.0f) {
+                stackNodes[stackSize] = nearChild;
+                stackDistances[stackSize] = nearEntry;
+                stackSize++;
+            }
+        }
+
+        if (hit)
+            distance = nearest;
+        return hit;
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef Bvh_hpp
+#define Bvh_hpp
+
+#include "Frustum.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    struct Aabb
+    {
+        glm::vec3 lower;
+        glm::vec3 upper;
+    };
+
+    // 32 bytes, two nodes per cache line. Nodes are stored depth first: an interior
+    // node's left child follows it directly and `offset` is its right child, a leaf
+    // (count > 0) owns the primitives [offset, offset + count) of the reordered arrays.
+    struct BvhNode
+    {
+        glm::vec3 lower;
+        uint32_t offset;
+        glm::vec3 upper;
+        uint32_t count;
+    };
+
+    // Bounding volume hierarchy over a set of primitive boxes, built with the binned
+    // surface area heuristic and flattened into one array. Moving primitives are
+    // handled by refit(), which keeps the topology and recomputes the node bounds from the
+    // new boxes, so they can grow or shrink.
+    class Bvh
+    {
+    public:
+        static const uint32_t MAX_LEAF_SIZE = 4;
+        static const int BIN_COUNT = 12;
+
+        Bvh();
+
+        void build(const std::vector<Aabb>& boxes);
+        // Boxes must be in the order given to build(), only their bounds may change
+        void refit(const std::vector<Aabb>& boxes);
+        void clear();
+
+        size_t getPrimitiveCount() const;
+        size_t getNodeCount() const;
+        // SAH cost of the tree relative to its root, grows as refits loosen the nodes
+        float getCost() const;
+
+        // Same contract as BoxSet::cull: one flag per primitive, returns the visible count.
+        // Subtrees entirely inside a plane stop testing it, fully inside ones are accepted whole.
+        size_t cull(const Frustum& frustum, std::vector<uint8_t>& visible) const;
+
+        // Nearest primitive box hit by the ray within maxDistance, nearer child visited first
+        bool intersectRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+            uint32_t& primitive, float& distance) const;
+
+    private:
+        // past this depth nodes split at the object median so traversal stacks stay bounded
+        static const int SAH_MAX_DEPTH = 40;
+        static const int STACK_SIZE = 64;
+
+        struct BuildPrimitive
+        {
+            Aabb box;
+            glm::vec3 centroid;
+            uint32_t index;
+        };
+
+        std::vector<BvhNode> nodes;
+        // primitive boxes and original indices in leaf order
+        std::vector<Aabb> primitiveBoxes;
+        std::vector<uint32_t> primitiveIndices;
+
+        void buildNode(std::vector<BuildPrimitive>& primitives, uint32_t nodeIndex, uint32_t first, uint32_t count, int depth);
+        // marks every primitive below the node visible, they are contiguous in leaf order
+        size_t acceptSubtree(uint32_t nodeIndex, std::vector<uint8_t>& visible) const;
+    };
+}
+
+#endif /* Bvh_hpp */
@@ -0,0 +1,158 @@
+#include "Frustum.hpp"
+
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define GPS_FRUSTUM_SSE 1
+#endif
+
+namespace gps {
+
+    Frustum Frustum::FromMatrix(const glm::mat4& viewProjection)
+    {
+        // Gribb/Hartmann: each plane is the last row plus or minus one of the others
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; i++)
+            row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+        Frustum frustum;
+        frustum.planes[0] = row[3] + row[0];
+        frustum.planes[1] = row[3] - row[0];
+        frustum.planes[2] = row[3] + row[1];
+        frustum.planes[3] = row[3] - row[1];
+        frustum.planes[4] = row[3] + row[2];
+        frustum.planes[5] = row[3] - row[2];
+
+        for (int i = 0; i < PLANE_COUNT; i++) {
+            float length = glm::length(glm::vec3(frustum.planes[i]));
+            if (length > 0.0f)
+                frustum.planes[i] /= length;
+        }
+        return frustum;
+    }
+
+    bool Frustum::intersectsBox(const glm::vec3& center, const glm::vec3& extents) const
+    {
+        for (int i = 0; i < PLANE_COUNT; i++) {
+            glm::vec3 normal(planes[i]);
+            float distance = glm::dot(normal, center) + planes[i].w;
+            float radius = glm::dot(glm::abs(normal), extents);
+            if (distance + radius < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    BoxSet::BoxSet()
+        : count(0)
+    {
+    }
+
+    void BoxSet::clear()
+    {
+        count = 0;
+        centerX.clear();
+        centerY.clear();
+        centerZ.clear();
+        extentX.clear();
+        extentY.clear();
+        extentZ.clear();
+    }
+
+    void BoxSet::add(const glm::vec3& center, const glm::vec3& extents)
+    {
+        // padding lanes are degenerate boxes at the origin, their results are never read
+        if (count % LANES == 0) {
+            size_t padded = count + LANES;
+            centerX.resize(padded, 0.0f);
+            centerY.resize(padded, 0.0f);
+            centerZ.resize(padded, 0.0f);
+            extentX.resize(padded, 0.0f);
+            extentY.resize(padded, 0.0f);
+            extentZ.resize(padded, 0.0f);
+        }
+        centerX[count] = center.x;
+        centerY[count] = center.y;
+        centerZ[count] = center.z;
+        extentX[count] = extents.x;
+        extentY[count] = extents.y;
+        extentZ[count] = extents.z;
+        count++;
+    }
+
+    size_t BoxSet::size() const
+    {
+        return count;
+    }
+
+    size_t BoxSet::cull(const Frustum& frustum, std::vector<uint8_t>& visible) const
+    {
+        visible.resize(centerX.size());
+        size_t visibleCount = 0;
+
+#ifdef GPS_FRUSTUM_SSE
+        // planes broadcast once, |n| precomputed for the box radius
+        __m128 planeX[Frustum::PLANE_COUNT], planeY[Frustum::PLANE_COUNT], planeZ[Frustum::PLANE_COUNT], planeW[Frustum::PLANE_COUNT];
+        __m128 absX[Frustum::PLANE_COUNT], absY[Frustum::PLANE_COUNT], absZ[Frustum::PLANE_COUNT];
+        for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+            const glm::vec4& plane = frustum.planes[p];
+            planeX[p] = _mm_set1_ps(plane.x);
+            planeY[p] = _mm_set1_ps(plane.y);
+            planeZ[p] = _mm_set1_ps(plane.z);
+            planeW[p] = _mm_set1_ps(plane.w);
+            absX[p] = _mm_set1_ps(std::fabs(plane.x));
+            absY[p] = _mm_set1_ps(std::fabs(plane.y));
+            absZ[p] = _mm_set1_ps(std::fabs(plane.z));
+        }
+        const __m128 zero = _mm_setzero_ps();
+
+        for (size_t i = 0; i < centerX.size(); i += LANES) {
+            __m128 cx = _mm_loadu_ps(&centerX[i]);
+            __m128 cy = _mm_loadu_ps(&centerY[i]);
+            __m128 cz = _mm_loadu_ps(&centerZ[i]);
+            __m128 ex = _mm_loadu_ps(&extentX[i]);
+            __m128 ey = _mm_loadu_ps(&extentY[i]);
+            __m128 ez = _mm_loadu_ps(&extentZ[i]);
+
+            __m128 outside = zero;
+            for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)),
+                    _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)),
+                    _mm_mul_ps(absZ[p], ez));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+            }
+
+            int mask = _mm_movemask_ps(outside);
+            for (size_t lane = 0; lane < LANES; lane++)
+                visible[i + lane] = (mask >> lane) & 1 ? 0 : 1;
+        }
+#else
+        for (size_t i = 0; i < centerX.size(); i++) {
+            glm::vec3 center(centerX[i], centerY[i], centerZ[i]);
+            glm::vec3 extents(extentX[i], extentY[i], extentZ[i]);
+            visible[i] = frustum.intersectsBox(center, extents) ? 1 : 0;
+        }
+#endif
+
+        visible.resize(count);
+        for (size_t i = 0; i < count; i++)
+            visibleCount += visible[i];
+        return visibleCount;
+    }
+
+    void TransformBox(const glm::mat4& transform, const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+        glm::vec3& center, glm::vec3& extents)
+    {
+        glm::vec3 localCenter = (boundsMin + boundsMax) * 0.5f;
+        glm::vec3 localExtents = (boundsMax - boundsMin) * 0.5f;
+
+        center = glm::vec3(transform * glm::vec4(localCenter, 1.0f));
+        for (int row = 0; row < 3; row++) {
+            extents[row] = std::fabs(transform[0][row]) * localExtents.x +
+                std::fabs(transform[1][row]) * localExtents.y +
+                std::fabs(transform[2][row]) * localExtents.z;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef Frustum_hpp
+#define Frustum_hpp
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Six inward facing planes (xyz normal, w distance): left, right, bottom, top, near, far.
+    // A point p is inside when dot(n, p) + w >= 0 for every plane.
+    struct Frustum
+    {
+        static const int PLANE_COUNT = 6;
+
+        glm::vec4 planes[PLANE_COUNT];
+
+        // Extracts the planes of a projection * view matrix, perspective or orthographic
+        static Frustum FromMatrix(const glm::mat4& viewProjection);
+
+        bool intersectsBox(const glm::vec3& center, const glm::vec3& extents) const;
+    };
+
+    // Axis aligned boxes stored as separate center/half-extent arrays, padded to a
+    // multiple of LANES so the culling loop tests LANES boxes at once with no scalar tail
+    class BoxSet
+    {
+    public:
+        static const size_t LANES = 4;
+
+        BoxSet();
+
+        void clear();
+        void add(const glm::vec3& center, const glm::vec3& extents);
+        size_t size() const;
+
+        // Writes 1 for boxes that touch the frustum and 0 for the others, returns the visible count
+        size_t cull(const Frustum& frustum, std::vector<uint8_t>& visible) const;
+
+    private:
+        size_t count;
+        std::vector<float> centerX, centerY, centerZ;
+        std::vector<float> extentX, extentY, extentZ;
+    };
+
+    // World space AABB of a local box under an affine transform (Arvo's method)
+    void TransformBox(const glm::mat4& transform, const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+        glm::vec3& center, glm::vec3& extents);
+}
+
+#endif /* Frustum_hpp */
@@ -0,0 +1,220 @@
+#include "Image.hpp"
+
+#include "stb_image.h"
+
+#include <cstdlib>
+#include <utility>
+
+namespace gps {
+
+    int Image::MipLevelCount(int width, int height)
+    {
+        int largest = width > height ? width : height;
+        int count = 1;
+        while (largest > 1) {
+            largest >>= 1;
+            count++;
+        }
+        return count;
+    }
+
+    size_t Image::BlockSize(ImageCompression compression)
+    {
+        switch (compression) {
+        case IMAGE_BC1:
+        case IMAGE_BC4:
+            return 8;
+        case IMAGE_BC3:
+        case IMAGE_BC5:
+            return 16;
+        default:
+            return 0;
+        }
+    }
+
+    size_t Image::LevelSize(int width, int height, int channels, ImageCompression compression)
+    {
+        if (compression == IMAGE_UNCOMPRESSED)
+            return (size_t)width * height * channels;
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BlockSize(compression);
+    }
+
+    Image::Image()
+        : pixels(NULL), byteSize(0), channels(0), compression(IMAGE_UNCOMPRESSED)
+    {
+    }
+
+    Image::~Image()
+    {
+        Release();
+    }
+
+    Image::Image(Image&& other) noexcept
+        : pixels(other.pixels), byteSize(other.byteSize), levels(std::move(other.levels)),
+        channels(other.channels), compression(other.compression)
+    {
+        other.pixels = NULL;
+        other.Release();
+    }
+
+    Image& Image::operator=(Image&& other) noexcept
+    {
+        if (this != &other) {
+            Release();
+            pixels = other.pixels;
+            byteSize = other.byteSize;
+            levels = std::move(other.levels);
+            channels = other.channels;
+            compression = other.compression;
+            other.pixels = NULL;
+            other.Release();
+        }
+        return *this;
+    }
+
+    bool Image::Load(const std::string& fileName, int channels, bool flipVertically)
+    {
+        Release();
+        int width, height, fileChannels;
+        // the flag is per thread, so workers decoding at once do not race on it
+        stbi_set_flip_vertically_on_load_thread(flipVertically ? 1 : 0);
+        pixels = stbi_load(fileName.c_str(), &width, &height, &fileChannels, channels);
+        if (!pixels)
+            return false;
+
+        this->channels = channels != 0 ? channels : fileChannels;
+        Level level = { width, height, 0, (size_t)width * height * this->channels };
+        levels.push_back(level);
+        byteSize = level.size;
+        return true;
+    }
+
+    void Image::Release()
+    {
+        if (pixels)
+            stbi_image_free(pixels);
+        pixels = NULL;
+        byteSize = 0;
+        levels.clear();
+        channels = 0;
+        compression = IMAGE_UNCOMPRESSED;
+    }
+
+    unsigned char* Image::Allocate(const std::vector<Level>& levels, int channels, ImageCompression compression)
+    {
+        Release();
+        size_t total = 0;
+        for (size_t i = 0; i < levels.size(); i++)
+            total += levels[i].size;
+
+        pixels = (unsigned char*)malloc(total > 0 ? total : 1);
+        if (!pixels)
+            return NULL;
+        byteSize = total;
+        this->levels = levels;
+        this->channels = channels;
+        this->compression = compression;
+        return pixels;
+    }
+
+    void Image::GenerateMipmaps()
+    {
+        if (levels.size() != 1 || compression != IMAGE_UNCOMPRESSED)
+            return;
+
+        int count = MipLevelCount(levels[0].width, levels[0].height);
+        size_t total = levels[0].size;
+        for (int i = 1; i < count; i++) {
+            const Level& parent = levels[i - 1];
+            Level level;
+            level.width = parent.width > 1 ? parent.width / 2 : 1;
+            level.height = parent.height > 1 ? parent.height / 2 : 1;
+            level.offset = total;
+            level.size = (size_t)level.width * level.height * channels;
+            levels.push_back(level);
+            total += level.size;
+        }
+
+        // the decoder allocates with malloc, so level 0 usually grows in place
+        unsigned char* grown = (unsigned char*)realloc(pixels, total);
+        if (!grown) {
+            levels.resize(1);
+            return;
+        }
+        pixels = grown;
+        byteSize = total;
+
+        // each texel averages a 2x2 block of its parent, a parent one texel wide or high
+        // repeats its only column or row and odd sizes drop their last one
+        for (int i = 1; i < count; i++) {
+            const Level& parent = levels[i - 1];
+            const Level& level = levels[i];
+            const unsigned char* source = pixels + parent.offset;
+            unsigned char* destination = pixels + level.offset;
+            size_t sourceStride = (size_t)parent.width * channels;
+
+            for (int y = 0; y < level.height; y++) {
+                const unsigned char* row0 = source + (size_t)(2 * y) * sourceStride;
+                const unsigned char* row1 = parent.height > 1 ? row0 + sourceStride : row0;
+                for (int x = 0; x < level.width; x++) {
+                    int x0 = 2 * x * channels;
+                    int x1 = parent.width > 1 ? x0 + channels : x0;
+                    for (int c = 0; c < channels; c++) {
+                        int sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+                        *destination++ = (unsigned char)((sum + 2) >> 2);
+                    }
+                }
+            }
+        }
+    }
+
+    bool Image::isLoaded() const
+    {
+        return !levels.empty();
+    }
+
+    int Image::getWidth() const
+    {
+        return levels.empty() ? 0 : levels[0].width;
+    }
+
+    int Image::getHeight() const
+    {
+        return levels.empty() ? 0 : levels[0].height;
+    }
+
+    int Image::getChannels() const
+    {
+        return channels;
+    }
+
+    ImageCompression Image::getCompression() const
+    {
+        return compression;
+    }
+
+    const unsigned char* Image::getPixels() const
+    {
+        return pixels;
+    }
+
+    size_t Image::getLevelCount() const
+    {
+        return levels.size();
+    }
+
+    const Image::Level& Image::getLevel(size_t level) const
+    {
+        return levels[level];
+    }
+
+    const unsigned char* Image::getLevelPixels(size_t level) const
+    {
+        return pixels + levels[level].offset;
+    }
+
+    size_t Image::getByteSize() const
+    {
+        return byteSize;
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef Image_hpp
+#define Image_hpp
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Layout of the pixel data, block formats store 4x4 texel blocks row by row
+    enum ImageCompression {
+        IMAGE_UNCOMPRESSED,
+        // RGB, 8 bytes per block
+        IMAGE_BC1,
+        // RGB with BC4 alpha, 16 bytes per block
+        IMAGE_BC3,
+        // one channel, 8 bytes per block
+        IMAGE_BC4,
+        // two BC4 channels, 16 bytes per block
+        IMAGE_BC5
+    };
+
+    // 8-bit pixels decoded on the CPU, rows stored top to bottom as in the file.
+    // Holds level 0 and optionally a full mip chain in one allocation, either as pixels
+    // or as compressed blocks read from a texture cache. Decoded pixels stay in the
+    // buffer the decoder returned, nothing is copied until the upload.
+    // Needs no GL context, so images can be decoded on worker threads.
+    class Image
+    {
+    public:
+        struct Level {
+            int width;
+            int height;
+            size_t offset;
+            size_t size;
+        };
+
+        // Levels from width x height down to 1x1
+        static int MipLevelCount(int width, int height);
+        // Bytes per 4x4 block, 0 for uncompressed pixels
+        static size_t BlockSize(ImageCompression compression);
+        // Bytes of one level with the given layout
+        static size_t LevelSize(int width, int height, int channels, ImageCompression compression);
+
+        Image();
+        ~Image();
+        Image(Image&& other) noexcept;
+        Image& operator=(Image&& other) noexcept;
+        Image(const Image&) = delete;
+        Image& operator=(const Image&) = delete;
+
+        // channels 0 keeps the file's channel count, otherwise pixels are converted to it.
+        // GL expects the bottom row first, flipVertically has the decoder write rows that way.
+        bool Load(const std::string& fileName, int channels = 0, bool flipVertically = false);
+        void Release();
+        // Replaces the contents with levels laid out back to back from offset 0,
+        // returns the buffer for the caller to fill
+        unsigned char* Allocate(const std::vector<Level>& levels, int channels, ImageCompression compression);
+
+        // Box-filters level 0 of uncompressed pixels down to 1x1, so the GL does not have to build the chain
+        void GenerateMipmaps();
+
+        bool isLoaded() const;
+        int getWidth() const;
+        int getHeight() const;
+        int getChannels() const;
+        ImageCompression getCompression() const;
+        const unsigned char* getPixels() const;
+
+        size_t getLevelCount() const;
+        const Level& getLevel(size_t level) const;
+        const unsigned char* getLevelPixels(size_t level) const;
+        // Bytes of every level together
+        size_t getByteSize() const;
+
+    private:
+        // allocated with malloc, as stb_image does
+        unsigned char* pixels;
+        size_t byteSize;
+        std::vector<Level> levels;
+        int channels;
+        ImageCompression compression;
+    };
+}
+
+#endif /* Image_hpp */
@@ -0,0 +1,136 @@
+#include "MappedFile.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace gps {
+
+    MappedFile::MappedFile()
+    {
+        data = NULL;
+        size = 0;
+#ifdef _WIN32
+        fileHandle = INVALID_HANDLE_VALUE;
+        mappingHandle = NULL;
+#else
+        fileDescriptor = -1;
+#endif
+    }
+
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+    bool MappedFile::Open(const std::string& fileName)
+    {
+        Close();
+#ifdef _WIN32
+        fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (fileHandle == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+            Close();
+            return false;
+        }
+        size = (size_t)fileSize.QuadPart;
+
+        mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!mappingHandle) {
+            Close();
+            return false;
+        }
+
+        data = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+        if (!data) {
+            Close();
+            return false;
+        }
+#else
+        fileDescriptor = open(fileName.c_str(), O_RDONLY);
+        if (fileDescriptor < 0)
+            return false;
+
+        struct stat fileInfo;
+        if (fstat(fileDescriptor, &fileInfo) != 0 || fileInfo.st_size == 0) {
+            Close();
+            return false;
+        }
+        size = (size_t)fileInfo.st_size;
+
+        void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        if (mapping == MAP_FAILED) {
+            Close();
+            return false;
+        }
+        data = (const unsigned char*)mapping;
+#endif
+        return true;
+    }
+
+    void MappedFile::Close()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mappingHandle)
+            CloseHandle(mappingHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE)
+            CloseHandle(fileHandle);
+        mappingHandle = NULL;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (data)
+            munmap((void*)data, size);
+        if (fileDescriptor >= 0)
+            close(fileDescriptor);
+        fileDescriptor = -1;
+#endif
+        data = NULL;
+        size = 0;
+    }
+
+    const unsigned char* MappedFile::getData() const
+    {
+        return data;
+    }
+
+    size_t MappedFile::getSize() const
+    {
+        return size;
+    }
+
+    bool MappedFile::isOpen() const
+    {
+        return data != NULL;
+    }
+
+    bool MappedFile::Stat(const std::string& fileName, uint64_t& size, int64_t& modificationTime)
+    {
+#ifdef _WIN32
+        struct _stat64 fileInfo;
+        if (_stat64(fileName.c_str(), &fileInfo) != 0)
+            return false;
+#else
+        struct stat fileInfo;
+        if (stat(fileName.c_str(), &fileInfo) != 0)
+            return false;
+#endif
+        size = (uint64_t)fileInfo.st_size;
+        modificationTime = (int64_t)fileInfo.st_mtime;
+        return true;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef MappedFile_hpp
+#define MappedFile_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace gps {
+
+    // Read-only memory mapping of a whole file
+    class MappedFile
+    {
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        bool Open(const std::string& fileName);
+        void Close();
+
+        const unsigned char* getData() const;
+        size_t getSize() const;
+        bool isOpen() const;
+
+        // Size and last modification time of a file on disk, false if it does not exist
+        static bool Stat(const std::string& fileName, uint64_t& size, int64_t& modificationTime);
+
+    private:
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+
+        const unsigned char* data;
+        size_t size;
+#ifdef _WIN32
+        void* fileHandle;
+        void* mappingHandle;
+#else
+        int fileDescriptor;
+#endif
+    };
+}
+
+#endif /* MappedFile_hpp */
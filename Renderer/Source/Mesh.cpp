@@ -1,45 +1,245 @@
 #include "Mesh.hpp"
+
+#include <glm/gtc/packing.hpp>
+
+#include <cmath>
+
 namespace gps {
 
+	namespace {
+
+		float signNotZero(float value)
+		{
+			return value >= 0.0f ? 1.0f : -1.0f;
+		}
+
+		// Maps a unit vector onto the octahedron and unfolds it into [-1, 1]^2
+		glm::vec2 octahedralEncode(glm::vec3 normal)
+		{
+			float length = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+			if (length == 0.0f)
+				return glm::vec2(0.0f);
+
+			glm::vec2 encoded = glm::vec2(normal.x, normal.y) / length;
+			if (normal.z < 0.0f) {
+				encoded = glm::vec2(
+					(1.0f - std::fabs(encoded.y)) * signNotZero(encoded.x),
+					(1.0f - std::fabs(encoded.x)) * signNotZero(encoded.y));
+			}
+			return encoded;
+		}
+
+		GLshort packSnorm16(float value)
+		{
+			return (GLshort)std::floor(glm::clamp(value, -1.0f, 1.0f) * 32767.0f + 0.5f);
+		}
+
+		GLushort packUnorm16(float value)
+		{
+			return (GLushort)std::floor(glm::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+		}
+	}
+
+	glm::mat3 ComputeNormalMatrix(const glm::mat4& model)
+	{
+		glm::mat3 linear(model);
+		float lengthSquared = glm::dot(linear[0], linear[0]);
+		float tolerance = lengthSquared * 1e-4f;
+		bool conformal = std::fabs(glm::dot(linear[1], linear[1]) - lengthSquared) <= tolerance &&
+			std::fabs(glm::dot(linear[2], linear[2]) - lengthSquared) <= tolerance &&
+			std::fabs(glm::dot(linear[0], linear[1])) <= tolerance &&
+			std::fabs(glm::dot(linear[0], linear[2])) <= tolerance &&
+			std::fabs(glm::dot(linear[1], linear[2])) <= tolerance;
+		if (conformal && lengthSquared > 0.0f)
+			return linear / lengthSquared;
+		return glm::transpose(glm::inverse(linear));
+	}
+
 	/* Mesh Constructor */
-	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures)
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, VertexFormat vertexFormat)
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		this->vertices = std::move(vertices);
+		this->indices = std::move(indices);
+		this->textures = std::move(textures);
+		this->vertexFormat = vertexFormat;
+		this->positionOffset = glm::vec3(0.0f);
+		this->positionScale = glm::vec3(1.0f);
+
+		for (size_t i = 0; i < this->textures.size(); i++)
+			this->textureUniforms.push_back(Shader::uniformId(this->textures[i].type));
 
+		this->computeBounds();
 		this->setupMesh();
 	}
 
+	Mesh::~Mesh()
+	{
+		releaseBuffers();
+	}
+
+	Mesh::Mesh(Mesh&& other) noexcept
+		: vertices(std::move(other.vertices)),
+		indices(std::move(other.indices)),
+		textures(std::move(other.textures)),
+		buffers(other.buffers),
+		textureUniforms(std::move(other.textureUniforms)),
+		vertexFormat(other.vertexFormat),
+		positionOffset(other.positionOffset),
+		positionScale(other.positionScale),
+		boundsMin(other.boundsMin),
+		boundsMax(other.boundsMax)
+	{
+		other.buffers.VAO = 0;
+		other.buffers.VBO = 0;
+		other.buffers.EBO = 0;
+	}
+
+	Mesh& Mesh::operator=(Mesh&& other) noexcept
+	{
+		if (this != &other) {
+			releaseBuffers();
+			this->vertices = std::move(other.vertices);
+			this->indices = std::move(other.indices);
+			this->textures = std::move(other.textures);
+			this->buffers = other.buffers;
+			this->textureUniforms = std::move(other.textureUniforms);
+			this->vertexFormat = other.vertexFormat;
+			this->positionOffset = other.positionOffset;
+			this->positionScale = other.positionScale;
+			this->boundsMin = other.boundsMin;
+			this->boundsMax = other.boundsMax;
+			other.buffers.VAO = 0;
+			other.buffers.VBO = 0;
+			other.buffers.EBO = 0;
+		}
+		return *this;
+	}
+
+	void Mesh::releaseBuffers()
+	{
+		// glDelete* silently ignores 0, moved-from meshes own nothing
+		if (this->buffers.VAO)
+			RenderState::Get().onVertexArrayDeleted(this->buffers.VAO);
+		glDeleteBuffers(1, &this->buffers.VBO);
+		glDeleteBuffers(1, &this->buffers.EBO);
+		glDeleteVertexArrays(1, &this->buffers.VAO);
+		this->buffers.VAO = 0;
+		this->buffers.VBO = 0;
+		this->buffers.EBO = 0;
+	}
+
 	Buffers Mesh::getBuffers() {
 	    return this->buffers;
 	}
 
-	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)
+	GLuint Mesh::getVertexArray() const
 	{
-		shader.useShaderProgram();
+		return this->buffers.VAO;
+	}
+
+	glm::vec3 Mesh::getBoundsMin() const
+	{
+		return this->boundsMin;
+	}
+
+	glm::vec3 Mesh::getBoundsMax() const
+	{
+		return this->boundsMax;
+	}
+
+	GLuint Mesh::getTextureSetKey() const
+	{
+		// materials in these models differ by their first (diffuse) texture
+		return this->textures.empty() ? 0 : this->textures[0].id;
+	}
+
+	void Mesh::computeBounds()
+	{
+		this->boundsMin = glm::vec3(0.0f);
+		this->boundsMax = glm::vec3(0.0f);
+		if (this->vertices.empty())
+			return;
 
-		//set textures
+		this->boundsMin = this->vertices[0].Position;
+		this->boundsMax = this->vertices[0].Position;
+		for (size_t i = 1; i < this->vertices.size(); i++) {
+			this->boundsMin = glm::min(this->boundsMin, this->vertices[i].Position);
+			this->boundsMax = glm::max(this->boundsMax, this->vertices[i].Position);
+		}
+	}
+
+	void Mesh::BindTextures(const gps::Shader& shader) const
+	{
 		for (GLuint i = 0; i < textures.size(); i++)
 		{
-			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
-			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
+			shader.setInt(this->textureUniforms[i], i);
+			RenderState::Get().bindTexture2D(i, this->textures[i].id);
 		}
+	}
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+	void Mesh::prepareDraw(const gps::Shader& shader) const
+	{
+		static const UniformId QUANTIZED_VERTICES = Shader::uniformId("quantizedVertices");
+		static const UniformId POSITION_OFFSET = Shader::uniformId("positionOffset");
+		static const UniformId POSITION_SCALE = Shader::uniformId("positionScale");
+
+		shader.useShaderProgram();
+		BindTextures(shader);
 
-        for(GLuint i = 0; i < this->textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, 0);
-        }
+		// tell the vertex shader how to decode this mesh's vertices
+		shader.setInt(QUANTIZED_VERTICES, this->vertexFormat == VERTEX_FORMAT_QUANTIZED);
+		if (this->vertexFormat == VERTEX_FORMAT_QUANTIZED) {
+			shader.setVec3(POSITION_OFFSET, this->positionOffset);
+			shader.setVec3(POSITION_SCALE, this->positionScale);
+		}
+
+		// bindings are left in place, the state cache skips them if the next draw needs the same
+		RenderState::Get().bindVertexArray(this->buffers.VAO);
+	}
 
+	/* Mesh drawing function - also applies associated textures */
+	void Mesh::Draw(const gps::Shader& shader) const
+	{
+		prepareDraw(shader);
+		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
     }
 
+	void Mesh::DrawInstanced(const gps::Shader& shader, GLsizei instanceCount, GLuint baseInstance) const
+	{
+		prepareDraw(shader);
+		if (baseInstance)
+			glDrawElementsInstancedBaseInstance(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0, instanceCount, baseInstance);
+		else
+			glDrawElementsInstanced(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0, instanceCount);
+	}
+
+	void Mesh::AttachInstanceBuffer(GLuint instanceBuffer)
+	{
+		RenderState::Get().bindVertexArray(this->buffers.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		SetupInstanceAttributes();
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		RenderState::Get().bindVertexArray(0);
+	}
+
+	void Mesh::SetupInstanceAttributes()
+	{
+		for (GLuint column = 0; column < 4; column++) {
+			GLuint location = INSTANCE_ATTRIBUTE + column;
+			glEnableVertexAttribArray(location);
+			glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+				(GLvoid*)(offsetof(InstanceData, model) + sizeof(glm::vec4) * column));
+			glVertexAttribDivisor(location, 1);
+		}
+		for (GLuint column = 0; column < 3; column++) {
+			GLuint location = INSTANCE_ATTRIBUTE + 4 + column;
+			glEnableVertexAttribArray(location);
+			glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+				(GLvoid*)(offsetof(InstanceData, normalMatrix) + sizeof(glm::vec3) * column));
+			glVertexAttribDivisor(location, 1);
+		}
+	}
+
 	// Initializes all the buffer objects/arrays
 	void Mesh::setupMesh(){
 		// Create buffers/arrays
@@ -47,14 +247,34 @@ namespace gps {
 		glGenBuffers(1, &this->buffers.VBO);
 		glGenBuffers(1, &this->buffers.EBO);
 
-		glBindVertexArray(this->buffers.VAO);
-		// Load data into vertex buffers
-		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+		RenderState::Get().bindVertexArray(this->buffers.VAO);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
 
+		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
+
+		if (this->vertexFormat == VERTEX_FORMAT_QUANTIZED) {
+			std::vector<PackedVertex> packedVertices = packVertices();
+			glBufferData(GL_ARRAY_BUFFER, packedVertices.size() * sizeof(PackedVertex), packedVertices.data(), GL_STATIC_DRAW);
+
+			// Vertex Positions - normalized to [0, 1] within the mesh bounds
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Position));
+			// Vertex Normals - octahedral, decoded in the vertex shader
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Normal));
+			// Vertex Texture Coords
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, TexCoords));
+
+			RenderState::Get().bindVertexArray(0);
+			return;
+		}
+
+		// Load data into vertex buffers
+		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+
 		// Set the vertex attribute pointers
 		// Vertex Positions
 		glEnableVertexAttribArray(0);
@@ -66,6 +286,40 @@ namespace gps {
 		glEnableVertexAttribArray(2);
 		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
 
-		glBindVertexArray(0);
+		RenderState::Get().bindVertexArray(0);
+	}
+
+	// Packs the vertices into the quantized layout, relative to the mesh bounds
+	std::vector<PackedVertex> Mesh::packVertices()
+	{
+		if (this->vertices.empty())
+			return std::vector<PackedVertex>();
+
+		this->positionOffset = boundsMin;
+		this->positionScale = boundsMax - boundsMin;
+		glm::vec3 inverseScale;
+		for (int axis = 0; axis < 3; axis++)
+			inverseScale[axis] = this->positionScale[axis] > 0.0f ? 1.0f / this->positionScale[axis] : 0.0f;
+
+		std::vector<PackedVertex> packedVertices(this->vertices.size());
+		for (size_t i = 0; i < this->vertices.size(); i++) {
+			const Vertex& vertex = this->vertices[i];
+			PackedVertex& packed = packedVertices[i];
+
+			glm::vec3 position = (vertex.Position - this->boundsMin) * inverseScale;
+			packed.Position[0] = packUnorm16(position.x);
+			packed.Position[1] = packUnorm16(position.y);
+			packed.Position[2] = packUnorm16(position.z);
+			packed.Position[3] = 0;
+
+			glm::vec2 normal = octahedralEncode(vertex.Normal);
+			packed.Normal[0] = packSnorm16(normal.x);
+			packed.Normal[1] = packSnorm16(normal.y);
+
+			packed.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+			packed.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+		}
+
+		return packedVertices;
 	}
 }
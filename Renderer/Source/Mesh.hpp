@@ -19,6 +19,35 @@ struct Vertex
     glm::vec2 TexCoords;
 };
 
+// GPU layout used by VERTEX_FORMAT_QUANTIZED, half the size of Vertex
+struct PackedVertex
+{
+    // unorm16 relative to the mesh bounds, w is padding
+    GLushort Position[4];
+    // octahedral encoded unit normal, snorm16
+    GLshort Normal[2];
+    // half floats
+    GLushort TexCoords[2];
+};
+
+// Per-instance attributes of instanced and batched draws, read when the
+// shader's instancedTransforms uniform is set
+struct InstanceData
+{
+    glm::mat4 model;
+    // inverse transpose of the model matrix's upper 3x3
+    glm::mat3 normalMatrix;
+};
+
+// Inverse transpose of the model matrix's upper 3x3. Rotations with a uniform scale
+// skip the inverse, their normal matrix is the 3x3 itself divided by the squared scale.
+glm::mat3 ComputeNormalMatrix(const glm::mat4& model);
+
+enum VertexFormat {
+    VERTEX_FORMAT_FLOAT,
+    VERTEX_FORMAT_QUANTIZED
+};
+
 struct Texture
 {
     GLuint id;
@@ -40,26 +69,72 @@ struct Buffers {
     GLuint EBO;
 };
 
+// Owns its VAO/VBO/EBO, so it can be moved but not copied
 class Mesh
 {
 public:
+    // InstanceData::model takes four attribute locations from here, normalMatrix the next three
+    static const GLuint INSTANCE_ATTRIBUTE = 3;
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
     std::vector<Texture> textures;
 
-	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
+	// The vectors are taken by value, pass them with std::move to avoid copying the geometry
+	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, VertexFormat vertexFormat = VERTEX_FORMAT_FLOAT);
+	~Mesh();
+	Mesh(Mesh&& other) noexcept;
+	Mesh& operator=(Mesh&& other) noexcept;
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
 
 	Buffers getBuffers();
+	GLuint getVertexArray() const;
+	// Object space bounding box of the vertices
+	glm::vec3 getBoundsMin() const;
+	glm::vec3 getBoundsMax() const;
+	// Identifies the texture set for draw sorting, meshes sharing it bind the same textures
+	GLuint getTextureSetKey() const;
+
+	// Binds the textures to units 0..n and points their sampler uniforms at them
+	void BindTextures(const gps::Shader& shader) const;
+
+	void Draw(const gps::Shader& shader) const;
+	// Draws instanceCount copies, the transforms come from the attached instance buffer
+	// starting at element baseInstance, which needs GL 4.2 or ARB_base_instance unless it is 0
+	void DrawInstanced(const gps::Shader& shader, GLsizei instanceCount, GLuint baseInstance = 0) const;
+
+	// Sources the instance attributes of this mesh's VAO from an InstanceData buffer
+	void AttachInstanceBuffer(GLuint instanceBuffer);
 
-	void Draw(gps::Shader shader);
+	// Points the instance attributes of the bound VAO at the bound GL_ARRAY_BUFFER
+	static void SetupInstanceAttributes();
 
 private:
     /*  Render data  */
     Buffers buffers;
+    // sampler uniform of each texture, resolved from Texture::type once
+    std::vector<UniformId> textureUniforms;
+    VertexFormat vertexFormat;
+    // dequantization of packed positions: position = positionOffset + unorm * positionScale
+    glm::vec3 positionOffset;
+    glm::vec3 positionScale;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
 
 	// Initializes all the buffer objects/arrays
 	void setupMesh();
 
+	void computeBounds();
+
+	// Binds textures, vertex decoding uniforms and the VAO for a draw
+	void prepareDraw(const gps::Shader& shader) const;
+
+	// Deletes the buffer objects/arrays, if any
+	void releaseBuffers();
+
+	// Packs the vertices into the quantized layout, relative to the mesh bounds
+	std::vector<PackedVertex> packVertices();
+
 };
 
 }
@@ -0,0 +1,221 @@
+#include "MeshBatch.hpp"
+
+#include "RenderState.hpp"
+
+#include <cstddef>
+
+namespace gps {
+
+    bool MeshBatch::IsSupported()
+    {
+        return GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+    }
+
+    MeshBatch::MeshBatch()
+        : stream(NULL), vertexArray(0), vertexBuffer(0), indexBuffer(0), transformBuffer(0), commandBuffer(0)
+    {
+    }
+
+    MeshBatch::~MeshBatch()
+    {
+        Release();
+    }
+
+    void MeshBatch::Release()
+    {
+        this->ranges.clear();
+        this->stream = NULL;
+        // an unbuilt batch may outlive the GL context
+        if (!this->vertexArray)
+            return;
+
+        RenderState::Get().onVertexArrayDeleted(this->vertexArray);
+        glDeleteVertexArrays(1, &this->vertexArray);
+        glDeleteBuffers(1, &this->vertexBuffer);
+        glDeleteBuffers(1, &this->indexBuffer);
+        glDeleteBuffers(1, &this->transformBuffer);
+        glDeleteBuffers(1, &this->commandBuffer);
+        this->vertexArray = 0;
+        this->vertexBuffer = 0;
+        this->indexBuffer = 0;
+        this->transformBuffer = 0;
+        this->commandBuffer = 0;
+    }
+
+    bool MeshBatch::isBuilt() const
+    {
+        return this->vertexArray != 0;
+    }
+
+    bool MeshBatch::contains(const Mesh& mesh) const
+    {
+        return this->ranges.count(&mesh) != 0;
+    }
+
+    void MeshBatch::Build(const std::vector<const Model3D*>& models, StreamBuffer* stream)
+    {
+        Release();
+        this->stream = (stream && stream->isCreated()) ? stream : NULL;
+
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+        for (size_t m = 0; m < models.size(); m++) {
+            const std::vector<Mesh>& meshes = models[m]->getMeshes();
+            for (size_t i = 0; i < meshes.size(); i++) {
+                const Mesh& mesh = meshes[i];
+                MeshRange range;
+                range.count = (GLuint)mesh.indices.size();
+                range.firstIndex = (GLuint)indices.size();
+                range.baseVertex = (GLint)vertices.size();
+                this->ranges[&mesh] = range;
+
+                vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+                indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+            }
+        }
+
+        glGenVertexArrays(1, &this->vertexArray);
+        glGenBuffers(1, &this->vertexBuffer);
+        glGenBuffers(1, &this->indexBuffer);
+        glGenBuffers(1, &this->transformBuffer);
+        glGenBuffers(1, &this->commandBuffer);
+
+        RenderState::Get().bindVertexArray(this->vertexArray);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ARRAY_BUFFER, this->vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+
+        // one InstanceData per command, stepped by baseInstance
+        glBindBuffer(GL_ARRAY_BUFFER, this->stream ? this->stream->getBuffer() : this->transformBuffer);
+        Mesh::SetupInstanceAttributes();
+
+        RenderState::Get().bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void MeshBatch::Submit(const RenderQueue& queue, const Shader& shader, UniformId modelUniform, UniformId normalMatrixUniform, bool bindTextures)
+    {
+        static const UniformId INSTANCED_TRANSFORMS = Shader::uniformId("instancedTransforms");
+        static const UniformId QUANTIZED_VERTICES = Shader::uniformId("quantizedVertices");
+
+        commands.clear();
+        transforms.clear();
+        runs.clear();
+        unbatched.clear();
+
+        for (size_t i = 0; i < queue.getSortedCount(); i++) {
+            const DrawItem& item = queue.getSortedItem(i);
+            std::unordered_map<const Mesh*, MeshRange>::const_iterator range = ranges.find(item.mesh);
+            if (range == ranges.end()) {
+                unbatched.push_back(&item);
+                continue;
+            }
+
+            bool newRun = runs.empty() ||
+                (bindTextures && runs.back().textureSource->getTextureSetKey() != item.mesh->getTextureSetKey());
+            if (newRun) {
+                CommandRun run;
+                run.first = commands.size();
+                run.count = 0;
+                run.textureSource = item.mesh;
+                runs.push_back(run);
+            }
+            runs.back().count++;
+
+            DrawElementsIndirectCommand command;
+            command.count = range->second.count;
+            command.instanceCount = 1;
+            command.firstIndex = range->second.firstIndex;
+            command.baseVertex = range->second.baseVertex;
+            command.baseInstance = (GLuint)transforms.size();
+            commands.push_back(command);
+            InstanceData instance;
+            instance.model = item.model;
+            instance.normalMatrix = item.normalMatrix;
+            transforms.push_back(instance);
+        }
+
+        shader.useShaderProgram();
+
+        GLuint indirectBuffer = 0;
+        GLintptr indirectOffset = 0;
+        if (!commands.empty() && !upload(indirectBuffer, indirectOffset)) {
+            // the stream ran out of room this frame, the same draws without batching
+            unbatched.clear();
+            for (size_t i = 0; i < queue.getSortedCount(); i++)
+                unbatched.push_back(&queue.getSortedItem(i));
+            commands.clear();
+        }
+
+        if (!commands.empty()) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            shader.setInt(INSTANCED_TRANSFORMS, 1);
+            shader.setInt(QUANTIZED_VERTICES, 0);
+            RenderState::Get().bindVertexArray(this->vertexArray);
+            for (size_t i = 0; i < runs.size(); i++) {
+                if (bindTextures)
+                    runs[i].textureSource->BindTextures(shader);
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                    (const GLvoid*)(indirectOffset + runs[i].first * sizeof(DrawElementsIndirectCommand)), (GLsizei)runs[i].count, 0);
+            }
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+            // the rest of the renderer relies on the uniform model matrix
+            shader.setInt(INSTANCED_TRANSFORMS, 0);
+        }
+
+        drawIndividually(unbatched, shader, modelUniform, normalMatrixUniform);
+    }
+
+    bool MeshBatch::upload(GLuint& indirectBuffer, GLintptr& indirectOffset)
+    {
+        GLsizeiptr transformBytes = transforms.size() * sizeof(InstanceData);
+        GLsizeiptr commandBytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+
+        if (!this->stream) {
+            // orphaned every pass so the driver never waits on the previous contents
+            glBindBuffer(GL_ARRAY_BUFFER, this->transformBuffer);
+            glBufferData(GL_ARRAY_BUFFER, transformBytes, transforms.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->commandBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commandBytes, commands.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            indirectBuffer = this->commandBuffer;
+            indirectOffset = 0;
+            return true;
+        }
+
+        // the attribute reads the stream from offset 0, so instances are placed at a
+        // multiple of their size and the commands' baseInstance is shifted to match
+        GLintptr transformOffset = this->stream->write(transforms.data(), transformBytes, sizeof(InstanceData));
+        if (transformOffset < 0)
+            return false;
+        GLuint firstInstance = (GLuint)(transformOffset / sizeof(InstanceData));
+        for (size_t i = 0; i < commands.size(); i++)
+            commands[i].baseInstance += firstInstance;
+
+        indirectOffset = this->stream->write(commands.data(), commandBytes, sizeof(GLuint));
+        if (indirectOffset < 0)
+            return false;
+        indirectBuffer = this->stream->getBuffer();
+        return true;
+    }
+
+    void MeshBatch::drawIndividually(const std::vector<const DrawItem*>& items, const Shader& shader, UniformId modelUniform, UniformId normalMatrixUniform) const
+    {
+        for (size_t i = 0; i < items.size(); i++) {
+            shader.setMat4(modelUniform, items[i]->model);
+            shader.setMat3(normalMatrixUniform, items[i]->normalMatrix);
+            items[i]->mesh->Draw(shader);
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef MeshBatch_hpp
+#define MeshBatch_hpp
+
+#include "Model3D.hpp"
+#include "RenderQueue.hpp"
+#include "StreamBuffer.hpp"
+
+#include <GLEW/glew.h>
+#include "glm/glm.hpp"
+
+#include <unordered_map>
+#include <vector>
+
+namespace gps {
+
+    // Layout of one glMultiDrawElementsIndirect command, fixed by the GL spec
+    struct DrawElementsIndirectCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // Packs static meshes into one shared vertex/index arena and draws a sorted
+    // RenderQueue with glMultiDrawElementsIndirect. Each command's baseInstance
+    // selects its InstanceData from a per-instance attribute buffer, the same
+    // attributes Model3D::DrawInstanced feeds.
+    // Needs GL 4.3 or ARB_multi_draw_indirect + ARB_base_instance, see IsSupported().
+    class MeshBatch
+    {
+    public:
+        static bool IsSupported();
+
+        MeshBatch();
+        ~MeshBatch();
+        MeshBatch(const MeshBatch&) = delete;
+        MeshBatch& operator=(const MeshBatch&) = delete;
+
+        // Copies the geometry of every mesh of the models into the arena, always as float vertices.
+        // The models must outlive the batch and keep their meshes in place. With a created
+        // stream, instances and commands are written into its current region every Submit.
+        void Build(const std::vector<const Model3D*>& models, StreamBuffer* stream = NULL);
+
+        void Release();
+
+        bool isBuilt() const;
+        bool contains(const Mesh& mesh) const;
+
+        // Draws the queue in the order of its last sort(). With bindTextures every run of items
+        // sharing a texture set is one multi-draw, otherwise the whole queue is a single one.
+        // Items whose mesh is not in the batch are drawn one by one afterwards.
+        void Submit(const RenderQueue& queue, const Shader& shader, UniformId modelUniform, UniformId normalMatrixUniform, bool bindTextures);
+
+    private:
+        struct MeshRange
+        {
+            GLuint count;
+            GLuint firstIndex;
+            GLint baseVertex;
+        };
+
+        // consecutive commands drawn with the textures of one mesh
+        struct CommandRun
+        {
+            size_t first;
+            size_t count;
+            const Mesh* textureSource;
+        };
+
+        std::unordered_map<const Mesh*, MeshRange> ranges;
+        StreamBuffer* stream;
+
+        GLuint vertexArray;
+        GLuint vertexBuffer;
+        GLuint indexBuffer;
+        GLuint transformBuffer;
+        GLuint commandBuffer;
+
+        // rebuilt for every Submit, kept to avoid reallocating
+        std::vector<DrawElementsIndirectCommand> commands;
+        std::vector<InstanceData> transforms;
+        std::vector<CommandRun> runs;
+        std::vector<const DrawItem*> unbatched;
+
+        // Copies instances and commands to the GPU, false when the stream is out of room
+        bool upload(GLuint& indirectBuffer, GLintptr& indirectOffset);
+        void drawIndividually(const std::vector<const DrawItem*>& items, const Shader& shader, UniformId modelUniform, UniformId normalMatrixUniform) const;
+    };
+}
+
+#endif /* MeshBatch_hpp */
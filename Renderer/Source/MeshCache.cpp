@@ -0,0 +1,283 @@
+#include "MeshCache.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace gps {
+
+    namespace {
+
+        const char CACHE_MAGIC[4] = { 'G', 'P', 'S', 'M' };
+        const uint64_t BLOB_ALIGNMENT = 16;
+        const uint32_t MAX_MESH_TEXTURES = 3;
+
+        struct StringRef {
+            uint32_t offset;
+            uint32_t length;
+        };
+
+        struct TextureRecord {
+            StringRef type;
+            StringRef path;
+        };
+
+        struct FileHeader {
+            char magic[4];
+            uint32_t version;
+            uint32_t vertexStride;
+            uint32_t meshCount;
+            uint32_t dependencyCount;
+            uint32_t padding;
+            uint64_t sourceSize;
+            int64_t sourceModificationTime;
+            uint64_t stringTableOffset;
+            uint64_t stringTableSize;
+            uint64_t fileSize;
+        };
+
+        struct MeshRecord {
+            uint64_t vertexOffset;
+            uint64_t indexOffset;
+            uint32_t vertexCount;
+            uint32_t indexCount;
+            uint32_t hasMaterial;
+            uint32_t textureCount;
+            float ambient[3];
+            float diffuse[3];
+            float specular[3];
+            uint32_t padding;
+            TextureRecord textures[MAX_MESH_TEXTURES];
+        };
+
+        // a file the meshes were built from besides the source
+        struct DependencyRecord {
+            StringRef path;
+            uint64_t size;
+            int64_t modificationTime;
+        };
+
+        uint64_t alignOffset(uint64_t offset)
+        {
+            return (offset + BLOB_ALIGNMENT - 1) & ~(BLOB_ALIGNMENT - 1);
+        }
+
+        StringRef appendString(std::string& table, const std::string& value)
+        {
+            StringRef ref;
+            ref.offset = (uint32_t)table.size();
+            ref.length = (uint32_t)value.size();
+            table += value;
+            return ref;
+        }
+
+        bool readString(const unsigned char* table, uint64_t tableSize, const StringRef& ref, std::string& value)
+        {
+            if ((uint64_t)ref.offset + ref.length > tableSize)
+                return false;
+            value.assign((const char*)table + ref.offset, ref.length);
+            return true;
+        }
+
+        void writePadding(std::ofstream& out, uint64_t from, uint64_t to)
+        {
+            static const char zeros[BLOB_ALIGNMENT] = { 0 };
+            if (to > from)
+                out.write(zeros, (std::streamsize)(to - from));
+        }
+    }
+
+    std::string MeshCache::GetCachePath(const std::string& sourceFileName)
+    {
+        return sourceFileName + ".meshcache";
+    }
+
+    bool MeshCache::Read(const std::string& sourceFileName, std::vector<MeshData>& meshes)
+    {
+        uint64_t sourceSize;
+        int64_t sourceModificationTime;
+        if (!MappedFile::Stat(sourceFileName, sourceSize, sourceModificationTime))
+            return false;
+
+        MappedFile file;
+        if (!file.Open(GetCachePath(sourceFileName)))
+            return false;
+
+        const unsigned char* data = file.getData();
+        uint64_t size = file.getSize();
+        if (size < sizeof(FileHeader))
+            return false;
+
+        FileHeader header;
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+            header.version != VERSION ||
+            header.vertexStride != sizeof(Vertex) ||
+            header.sourceSize != sourceSize ||
+            header.sourceModificationTime != sourceModificationTime ||
+            header.fileSize != size) {
+            return false;
+        }
+
+        uint64_t dependenciesOffset = sizeof(FileHeader) + (uint64_t)header.meshCount * sizeof(MeshRecord);
+        uint64_t recordsEnd = dependenciesOffset + (uint64_t)header.dependencyCount * sizeof(DependencyRecord);
+        if (recordsEnd > size || header.stringTableOffset + header.stringTableSize > size)
+            return false;
+
+        const unsigned char* stringTable = data + header.stringTableOffset;
+
+        for (uint32_t d = 0; d < header.dependencyCount; d++) {
+            DependencyRecord record;
+            memcpy(&record, data + dependenciesOffset + d * sizeof(DependencyRecord), sizeof(record));
+            std::string path;
+            uint64_t dependencySize;
+            int64_t dependencyModificationTime;
+            if (!readString(stringTable, header.stringTableSize, record.path, path) ||
+                !MappedFile::Stat(path, dependencySize, dependencyModificationTime) ||
+                record.size != dependencySize || record.modificationTime != dependencyModificationTime) {
+                return false;
+            }
+        }
+        std::vector<MeshData> loaded(header.meshCount);
+
+        for (uint32_t m = 0; m < header.meshCount; m++) {
+            MeshRecord record;
+            memcpy(&record, data + sizeof(FileHeader) + m * sizeof(MeshRecord), sizeof(record));
+
+            uint64_t vertexBytes = (uint64_t)record.vertexCount * sizeof(Vertex);
+            uint64_t indexBytes = (uint64_t)record.indexCount * sizeof(GLuint);
+            if (record.vertexOffset + vertexBytes > size || record.indexOffset + indexBytes > size ||
+                record.textureCount > MAX_MESH_TEXTURES) {
+                return false;
+            }
+
+            MeshData& mesh = loaded[m];
+            // bulk copies straight out of the mapping, nothing is parsed
+            mesh.vertices.resize(record.vertexCount);
+            if (vertexBytes > 0)
+                memcpy(mesh.vertices.data(), data + record.vertexOffset, (size_t)vertexBytes);
+            mesh.indices.resize(record.indexCount);
+            if (indexBytes > 0)
+                memcpy(mesh.indices.data(), data + record.indexOffset, (size_t)indexBytes);
+
+            mesh.hasMaterial = record.hasMaterial != 0;
+            mesh.material.ambient = glm::vec3(record.ambient[0], record.ambient[1], record.ambient[2]);
+            mesh.material.diffuse = glm::vec3(record.diffuse[0], record.diffuse[1], record.diffuse[2]);
+            mesh.material.specular = glm::vec3(record.specular[0], record.specular[1], record.specular[2]);
+
+            mesh.textures.resize(record.textureCount);
+            for (uint32_t t = 0; t < record.textureCount; t++) {
+                if (!readString(stringTable, header.stringTableSize, record.textures[t].type, mesh.textures[t].type) ||
+                    !readString(stringTable, header.stringTableSize, record.textures[t].path, mesh.textures[t].path)) {
+                    return false;
+                }
+            }
+        }
+
+        meshes.swap(loaded);
+        return true;
+    }
+
+    bool MeshCache::Write(const std::string& sourceFileName, const std::vector<MeshData>& meshes,
+        const std::vector<std::string>& dependencies)
+    {
+        FileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.version = VERSION;
+        header.vertexStride = sizeof(Vertex);
+        header.meshCount = (uint32_t)meshes.size();
+        header.dependencyCount = (uint32_t)dependencies.size();
+        if (!MappedFile::Stat(sourceFileName, header.sourceSize, header.sourceModificationTime))
+            return false;
+
+        // lay out the records and blobs before writing anything
+        std::vector<MeshRecord> records(meshes.size());
+        std::vector<DependencyRecord> dependencyRecords(dependencies.size());
+        std::string stringTable;
+
+        for (size_t d = 0; d < dependencies.size(); d++) {
+            DependencyRecord& record = dependencyRecords[d];
+            memset(&record, 0, sizeof(record));
+            if (!MappedFile::Stat(dependencies[d], record.size, record.modificationTime))
+                return false;
+            record.path = appendString(stringTable, dependencies[d]);
+        }
+
+        uint64_t offset = sizeof(FileHeader) + meshes.size() * sizeof(MeshRecord) +
+            dependencies.size() * sizeof(DependencyRecord);
+
+        for (size_t m = 0; m < meshes.size(); m++) {
+            const MeshData& mesh = meshes[m];
+            MeshRecord& record = records[m];
+            memset(&record, 0, sizeof(record));
+
+            offset = alignOffset(offset);
+            record.vertexOffset = offset;
+            record.vertexCount = (uint32_t)mesh.vertices.size();
+            offset += mesh.vertices.size() * sizeof(Vertex);
+
+            offset = alignOffset(offset);
+            record.indexOffset = offset;
+            record.indexCount = (uint32_t)mesh.indices.size();
+            offset += mesh.indices.size() * sizeof(GLuint);
+
+            record.hasMaterial = mesh.hasMaterial ? 1 : 0;
+            for (int i = 0; i < 3; i++) {
+                record.ambient[i] = mesh.material.ambient[i];
+                record.diffuse[i] = mesh.material.diffuse[i];
+                record.specular[i] = mesh.material.specular[i];
+            }
+
+            record.textureCount = (uint32_t)std::min<size_t>(mesh.textures.size(), MAX_MESH_TEXTURES);
+            for (uint32_t t = 0; t < record.textureCount; t++) {
+                record.textures[t].type = appendString(stringTable, mesh.textures[t].type);
+                record.textures[t].path = appendString(stringTable, mesh.textures[t].path);
+            }
+        }
+
+        header.stringTableOffset = offset;
+        header.stringTableSize = stringTable.size();
+        header.fileSize = offset + stringTable.size();
+
+        // write to a temporary file first so a crash never leaves a half written cache behind
+        std::string cachePath = GetCachePath(sourceFileName);
+        std::string tempPath = cachePath + ".tmp";
+        std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)records.data(), (std::streamsize)(records.size() * sizeof(MeshRecord)));
+        out.write((const char*)dependencyRecords.data(), (std::streamsize)(dependencyRecords.size() * sizeof(DependencyRecord)));
+        uint64_t written = sizeof(FileHeader) + records.size() * sizeof(MeshRecord) +
+            dependencyRecords.size() * sizeof(DependencyRecord);
+
+        for (size_t m = 0; m < meshes.size(); m++) {
+            writePadding(out, written, records[m].vertexOffset);
+            out.write((const char*)meshes[m].vertices.data(), (std::streamsize)(meshes[m].vertices.size() * sizeof(Vertex)));
+            written = records[m].vertexOffset + meshes[m].vertices.size() * sizeof(Vertex);
+
+            writePadding(out, written, records[m].indexOffset);
+            out.write((const char*)meshes[m].indices.data(), (std::streamsize)(meshes[m].indices.size() * sizeof(GLuint)));
+            written = records[m].indexOffset + meshes[m].indices.size() * sizeof(GLuint);
+        }
+        out.write(stringTable.data(), (std::streamsize)stringTable.size());
+        out.close();
+
+        if (!out) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+
+        std::remove(cachePath.c_str());
+        if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+
+        return true;
+    }
+}
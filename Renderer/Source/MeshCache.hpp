@@ -0,0 +1,51 @@
+#ifndef MeshCache_hpp
+#define MeshCache_hpp
+
+#include "Mesh.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // A texture referenced by a material, path relative to the model's base path
+    struct TextureRef
+    {
+        std::string type;
+        std::string path;
+    };
+
+    // CPU side result of loading one shape, before anything is uploaded to the GPU
+    struct MeshData
+    {
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+        bool hasMaterial;
+        Material material;
+        std::vector<TextureRef> textures;
+    };
+
+    // Binary cache written next to a source model as "<model>.meshcache".
+    // Layout: header, one record per mesh, one record per dependency, packed vertex and
+    // index blobs, string table. The cache is rejected when the version, vertex layout,
+    // or the size or modification time of the source file or of any dependency (the
+    // .mtl files its materials and texture paths came from) no longer match.
+    class MeshCache
+    {
+    public:
+        static const uint32_t VERSION = 4;
+
+        static std::string GetCachePath(const std::string& sourceFileName);
+
+        // Maps the cache for sourceFileName and fills meshes, false if missing or stale
+        static bool Read(const std::string& sourceFileName, std::vector<MeshData>& meshes);
+
+        // Writes the cache for sourceFileName, false if it could not be written.
+        // dependencies are the other files the meshes were built from.
+        static bool Write(const std::string& sourceFileName, const std::vector<MeshData>& meshes,
+            const std::vector<std::string>& dependencies = std::vector<std::string>());
+    };
+}
+
+#endif /* MeshCache_hpp */
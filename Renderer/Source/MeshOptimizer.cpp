@@ -0,0 +1,338 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    namespace {
+
+        // Forsyth scoring parameters
+        const int FORSYTH_CACHE_SIZE = 32;
+        const float CACHE_DECAY_POWER = 1.5f;
+        const float LAST_TRIANGLE_SCORE = 0.75f;
+        const float VALENCE_BOOST_SCALE = 2.0f;
+        const float VALENCE_BOOST_POWER = 0.5f;
+
+        float vertexScore(int cachePosition, unsigned remainingTriangles)
+        {
+            // vertices with no triangles left never attract anything
+            if (remainingTriangles == 0)
+                return -1.0f;
+
+            float score = 0.0f;
+            if (cachePosition >= 0) {
+                if (cachePosition < 3) {
+                    // used by the last triangle, fixed score so it is not reused immediately
+                    score = LAST_TRIANGLE_SCORE;
+                }
+                else {
+                    float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+                    score = std::pow(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+                }
+            }
+
+            // favour vertices with few triangles left so they get finished off
+            score += VALENCE_BOOST_SCALE * std::pow((float)remainingTriangles, -VALENCE_BOOST_POWER);
+            return score;
+        }
+
+        // Number of misses the triangle causes in a FIFO cache, inserting missed vertices
+        unsigned simulateTriangle(const GLuint* triangle, std::vector<unsigned>& timestamps, unsigned& time, unsigned cacheSize)
+        {
+            unsigned misses = 0;
+            for (int k = 0; k < 3; k++) {
+                GLuint vertex = triangle[k];
+                if (time - timestamps[vertex] > cacheSize) {
+                    timestamps[vertex] = time++;
+                    misses++;
+                }
+            }
+            return misses;
+        }
+
+        struct Cluster {
+            size_t firstTriangle;
+            size_t triangleCount;
+            float sortKey;
+        };
+
+        bool compareClusters(const Cluster& a, const Cluster& b)
+        {
+            return a.sortKey > b.sortKey;
+        }
+    }
+
+    VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, unsigned cacheSize)
+    {
+        VertexCacheStats stats = { 0.0f, 0.0f, indices.size() / 3, 0 };
+        if (stats.triangleCount == 0)
+            return stats;
+
+        // a vertex is resident while fewer than cacheSize insertions happened since it was added
+        std::vector<unsigned> timestamps(vertexCount, 0);
+        std::vector<char> referenced(vertexCount, 0);
+        unsigned time = cacheSize + 1;
+        size_t misses = 0;
+
+        for (size_t t = 0; t < stats.triangleCount; t++) {
+            misses += simulateTriangle(&indices[t * 3], timestamps, time, cacheSize);
+            for (int k = 0; k < 3; k++)
+                referenced[indices[t * 3 + k]] = 1;
+        }
+
+        for (size_t v = 0; v < vertexCount; v++)
+            stats.vertexCount += referenced[v];
+
+        stats.acmr = (float)misses / stats.triangleCount;
+        stats.atvr = stats.vertexCount > 0 ? (float)misses / stats.vertexCount : 0.0f;
+        return stats;
+    }
+
+    void MeshOptimizer::OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        // vertex -> triangle adjacency, the first remainingTriangles[v] entries are the unemitted ones
+        std::vector<unsigned> remainingTriangles(vertexCount, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            remainingTriangles[indices[i]]++;
+
+        std::vector<unsigned> adjacencyOffsets(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remainingTriangles[v];
+
+        std::vector<unsigned> adjacency(triangleCount * 3);
+        std::vector<unsigned> fillCursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            adjacency[fillCursor[indices[i]]++] = (unsigned)(i / 3);
+
+        std::vector<int> cachePositions(vertexCount, -1);
+        std::vector<float> vertexScores(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            vertexScores[v] = vertexScore(-1, remainingTriangles[v]);
+
+        std::vector<float> triangleScores(triangleCount);
+        std::vector<char> emitted(triangleCount, 0);
+        long bestTriangle = 0;
+        for (size_t t = 0; t < triangleCount; t++) {
+            triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+            if (triangleScores[t] > triangleScores[bestTriangle])
+                bestTriangle = (long)t;
+        }
+
+        std::vector<GLuint> result;
+        result.reserve(triangleCount * 3);
+
+        std::vector<GLuint> cache;
+        std::vector<GLuint> newCache;
+        cache.reserve(FORSYTH_CACHE_SIZE + 3);
+        newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+        size_t scanCursor = 0;
+
+        while (bestTriangle >= 0) {
+            const GLuint* triangle = &indices[bestTriangle * 3];
+            emitted[bestTriangle] = 1;
+            result.insert(result.end(), triangle, triangle + 3);
+
+            // the emitted triangle's vertices move to the front of the LRU cache
+            newCache.clear();
+            for (int k = 0; k < 3; k++) {
+                GLuint vertex = triangle[k];
+                newCache.push_back(vertex);
+
+                // drop the triangle from the vertex's remaining adjacency
+                unsigned* begin = &adjacency[adjacencyOffsets[vertex]];
+                unsigned* end = begin + remainingTriangles[vertex];
+                unsigned* found = std::find(begin, end, (unsigned)bestTriangle);
+                if (found != end) {
+                    *found = *(end - 1);
+                    remainingTriangles[vertex]--;
+                }
+            }
+            for (size_t c = 0; c < cache.size(); c++) {
+                GLuint vertex = cache[c];
+                if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+                    newCache.push_back(vertex);
+            }
+
+            // vertices pushed past the end of the cache lose their position bonus
+            for (size_t c = FORSYTH_CACHE_SIZE; c < newCache.size(); c++) {
+                GLuint vertex = newCache[c];
+                cachePositions[vertex] = -1;
+                vertexScores[vertex] = vertexScore(-1, remainingTriangles[vertex]);
+            }
+            if (newCache.size() > (size_t)FORSYTH_CACHE_SIZE)
+                newCache.resize(FORSYTH_CACHE_SIZE);
+            cache.swap(newCache);
+
+            for (size_t c = 0; c < cache.size(); c++) {
+                GLuint vertex = cache[c];
+                cachePositions[vertex] = (int)c;
+                vertexScores[vertex] = vertexScore((int)c, remainingTriangles[vertex]);
+            }
+
+            // only triangles touching the cache changed score, the next one is picked among them
+            bestTriangle = -1;
+            float bestScore = -1.0f;
+            for (size_t c = 0; c < cache.size(); c++) {
+                GLuint vertex = cache[c];
+                unsigned begin = adjacencyOffsets[vertex];
+                for (unsigned a = begin; a < begin + remainingTriangles[vertex]; a++) {
+                    unsigned t = adjacency[a];
+                    float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+                    triangleScores[t] = score;
+                    if (score > bestScore) {
+                        bestScore = score;
+                        bestTriangle = (long)t;
+                    }
+                }
+            }
+
+            // nothing adjacent to the cache is left, continue with the next unemitted triangle
+            if (bestTriangle < 0) {
+                while (scanCursor < triangleCount && emitted[scanCursor])
+                    scanCursor++;
+                if (scanCursor < triangleCount)
+                    bestTriangle = (long)scanCursor;
+            }
+        }
+
+        indices.swap(result);
+    }
+
+    void MeshOptimizer::OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<Vertex>& vertices, float threshold)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        std::vector<unsigned> timestamps(vertices.size(), 0);
+        unsigned time = DEFAULT_CACHE_SIZE + 1;
+
+        // hard boundaries: triangles that miss on all three vertices start a new strip-like run
+        std::vector<size_t> hardBoundaries;
+        for (size_t t = 0; t < triangleCount; t++) {
+            if (simulateTriangle(&indices[t * 3], timestamps, time, DEFAULT_CACHE_SIZE) == 3)
+                hardBoundaries.push_back(t);
+        }
+        if (hardBoundaries.empty() || hardBoundaries[0] != 0)
+            hardBoundaries.insert(hardBoundaries.begin(), 0);
+        hardBoundaries.push_back(triangleCount);
+
+        // soft boundaries: split each run further wherever the local ACMR is already good enough
+        std::vector<Cluster> clusters;
+        for (size_t h = 0; h + 1 < hardBoundaries.size(); h++) {
+            size_t start = hardBoundaries[h];
+            size_t end = hardBoundaries[h + 1];
+
+            time += DEFAULT_CACHE_SIZE + 1;
+            size_t clusterMisses = 0;
+            for (size_t t = start; t < end; t++)
+                clusterMisses += simulateTriangle(&indices[t * 3], timestamps, time, DEFAULT_CACHE_SIZE);
+            float clusterThreshold = threshold * (float)clusterMisses / (float)(end - start);
+
+            time += DEFAULT_CACHE_SIZE + 1;
+            size_t clusterStart = start;
+            size_t runningMisses = 0;
+            for (size_t t = start; t < end; t++) {
+                runningMisses += simulateTriangle(&indices[t * 3], timestamps, time, DEFAULT_CACHE_SIZE);
+                size_t runningTriangles = t + 1 - clusterStart;
+
+                if (t + 1 < end && (float)runningMisses / runningTriangles <= clusterThreshold) {
+                    Cluster cluster = { clusterStart, runningTriangles, 0.0f };
+                    clusters.push_back(cluster);
+                    clusterStart = t + 1;
+                    runningMisses = 0;
+                    time += DEFAULT_CACHE_SIZE + 1;
+                }
+            }
+            Cluster cluster = { clusterStart, end - clusterStart, 0.0f };
+            clusters.push_back(cluster);
+        }
+
+        // area weighted centroid of the whole mesh
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        for (size_t t = 0; t < triangleCount; t++) {
+            const glm::vec3& p0 = vertices[indices[t * 3]].Position;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+            float area = glm::length(glm::cross(p1 - p0, p2 - p0));
+            meshCentroid += area * (p0 + p1 + p2) / 3.0f;
+            meshArea += area;
+        }
+        if (meshArea > 0.0f)
+            meshCentroid /= meshArea;
+
+        // clusters facing away from the mesh centre are likely occluders, draw them first
+        for (size_t c = 0; c < clusters.size(); c++) {
+            glm::vec3 centroid(0.0f);
+            glm::vec3 normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusters[c].firstTriangle; t < clusters[c].firstTriangle + clusters[c].triangleCount; t++) {
+                const glm::vec3& p0 = vertices[indices[t * 3]].Position;
+                const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+                const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+                glm::vec3 weightedNormal = glm::cross(p1 - p0, p2 - p0);
+                float triangleArea = glm::length(weightedNormal);
+                centroid += triangleArea * (p0 + p1 + p2) / 3.0f;
+                normal += weightedNormal;
+                area += triangleArea;
+            }
+            if (area > 0.0f)
+                centroid /= area;
+            float normalLength = glm::length(normal);
+            if (normalLength > 0.0f)
+                normal /= normalLength;
+
+            clusters[c].sortKey = glm::dot(centroid - meshCentroid, normal);
+        }
+
+        std::stable_sort(clusters.begin(), clusters.end(), compareClusters);
+
+        std::vector<GLuint> result;
+        result.reserve(indices.size());
+        for (size_t c = 0; c < clusters.size(); c++) {
+            std::vector<GLuint>::const_iterator first = indices.begin() + clusters[c].firstTriangle * 3;
+            result.insert(result.end(), first, first + clusters[c].triangleCount * 3);
+        }
+        indices.swap(result);
+    }
+
+    void MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+    {
+        const GLuint UNUSED = (GLuint)-1;
+        std::vector<GLuint> remap(vertices.size(), UNUSED);
+        std::vector<Vertex> result;
+        result.reserve(vertices.size());
+
+        // vertices that are never referenced are dropped
+        for (size_t i = 0; i < indices.size(); i++) {
+            GLuint& newIndex = remap[indices[i]];
+            if (newIndex == UNUSED) {
+                newIndex = (GLuint)result.size();
+                result.push_back(vertices[indices[i]]);
+            }
+            indices[i] = newIndex;
+        }
+
+        vertices.swap(result);
+    }
+
+    void MeshOptimizer::Optimize(std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+        VertexCacheStats* before, VertexCacheStats* after)
+    {
+        if (before)
+            *before = AnalyzeVertexCache(indices, vertices.size());
+
+        OptimizeVertexCache(indices, vertices.size());
+        OptimizeOverdraw(indices, vertices);
+        OptimizeVertexFetch(vertices, indices);
+
+        if (after)
+            *after = AnalyzeVertexCache(indices, vertices.size());
+    }
+}
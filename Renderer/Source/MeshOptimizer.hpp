@@ -0,0 +1,46 @@
+#ifndef MeshOptimizer_hpp
+#define MeshOptimizer_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Result of simulating a FIFO post-transform vertex cache over an index buffer
+    struct VertexCacheStats
+    {
+        // average cache misses per triangle, 0.5 is ideal and 3.0 is the worst case
+        float acmr;
+        // average transforms per vertex, 1.0 is ideal
+        float atvr;
+        size_t triangleCount;
+        size_t vertexCount;
+    };
+
+    // Load-time reordering of indexed triangle meshes before they are uploaded.
+    // Run the passes in the order cache -> overdraw -> fetch, as Optimize() does.
+    class MeshOptimizer
+    {
+    public:
+        static const unsigned DEFAULT_CACHE_SIZE = 16;
+
+        static VertexCacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, unsigned cacheSize = DEFAULT_CACHE_SIZE);
+
+        // Reorders triangles for post-transform cache locality (Forsyth's linear-speed algorithm)
+        static void OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount);
+
+        // Splits the cache-optimized order into clusters and sorts them so outward facing
+        // clusters come first (Tipsify-style). threshold bounds how much ACMR may degrade.
+        static void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<Vertex>& vertices, float threshold = 1.05f);
+
+        // Renumbers vertices in first-use order so vertex fetches walk memory linearly
+        static void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+        // Runs all three passes, filling before/after statistics when requested
+        static void Optimize(std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+            VertexCacheStats* before = NULL, VertexCacheStats* after = NULL);
+    };
+}
+
+#endif /* MeshOptimizer_hpp */
@@ -1,27 +1,188 @@
 #include "Model3D.hpp"
 
+#include <unordered_map>
+
 namespace gps {
 
+	namespace {
+
+		// Identifies a unique face corner by its position/normal/texcoord indices in the .obj
+		struct VertexKey {
+			int vertex_index;
+			int normal_index;
+			int texcoord_index;
+
+			bool operator==(const VertexKey& other) const {
+				return vertex_index == other.vertex_index &&
+					normal_index == other.normal_index &&
+					texcoord_index == other.texcoord_index;
+			}
+		};
+
+		struct VertexKeyHash {
+			size_t operator()(const VertexKey& key) const {
+				size_t hash = (size_t)key.vertex_index * 73856093u;
+				hash ^= (size_t)key.normal_index * 19349663u;
+				hash ^= (size_t)key.texcoord_index * 83492791u;
+				return hash;
+			}
+		};
+	}
+
+	Model3D::Model3D()
+	{
+		vertexFormat = VERTEX_FORMAT_FLOAT;
+		instanceBuffer = 0;
+		attachedInstanceBuffer = 0;
+	}
+
+	Model3D::Model3D(Model3D&& other) noexcept
+		: meshes(std::move(other.meshes)),
+		loadedTextures(std::move(other.loadedTextures)),
+		vertexFormat(other.vertexFormat),
+		instanceBuffer(other.instanceBuffer),
+		attachedInstanceBuffer(other.attachedInstanceBuffer)
+	{
+		other.instanceBuffer = 0;
+		other.attachedInstanceBuffer = 0;
+		other.meshes.clear();
+		other.loadedTextures.clear();
+	}
+
+	Model3D& Model3D::operator=(Model3D&& other) noexcept
+	{
+		if (this != &other) {
+			releaseTextures();
+			releaseInstanceBuffer();
+			meshes = std::move(other.meshes);
+			loadedTextures = std::move(other.loadedTextures);
+			vertexFormat = other.vertexFormat;
+			instanceBuffer = other.instanceBuffer;
+			attachedInstanceBuffer = other.attachedInstanceBuffer;
+			other.instanceBuffer = 0;
+			other.attachedInstanceBuffer = 0;
+			other.meshes.clear();
+			other.loadedTextures.clear();
+		}
+		return *this;
+	}
+
+	void Model3D::SetVertexFormat(gps::VertexFormat format)
+	{
+		vertexFormat = format;
+	}
+
 	void Model3D::LoadModel(std::string fileName)
 	{
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-		ReadOBJ(fileName, basePath);
+		LoadModel(fileName, basePath);
 	}
 
     void Model3D::LoadModel(std::string fileName, std::string basePath)
 	{
-		ReadOBJ(fileName, basePath);
+		std::vector<gps::MeshData> meshData;
+		if (!ReadModelData(fileName, basePath, meshData)) {
+			std::cerr << "ERROR: could not load " << fileName << std::endl;
+			return;
+		}
+		BuildMeshes(meshData, basePath);
+	}
+
+	bool Model3D::ReadModelData(const std::string& fileName, const std::string& basePath, std::vector<gps::MeshData>& meshData)
+	{
+		// use the binary cache when it is up to date, otherwise parse the .obj and refresh it
+		if (gps::MeshCache::Read(fileName, meshData)) {
+			std::cout << "Loading cached : " << fileName << std::endl;
+			return true;
+		}
+		// the cache also goes stale when a material library changes
+		std::vector<std::string> materialFiles;
+		if (!ReadOBJ(fileName, basePath, meshData, &materialFiles))
+			return false;
+		if (!gps::MeshCache::Write(fileName, meshData, materialFiles)) {
+			std::cerr << "WARNING: could not write " << gps::MeshCache::GetCachePath(fileName) << std::endl;
+		}
+		return true;
+	}
+
+	const std::vector<gps::Mesh>& Model3D::getMeshes() const {
+
+		return meshes;
 	}
 
 	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram)
+	void Model3D::Draw(const gps::Shader& shaderProgram) const
 	{
 		for (int i = 0; i < meshes.size(); i++)
 			meshes[i].Draw(shaderProgram);
 	}
 
+	void Model3D::DrawInstanced(const gps::Shader& shaderProgram, const glm::mat4* transforms, const glm::mat3* normalMatrices, size_t count, gps::StreamBuffer* stream)
+	{
+		static const UniformId INSTANCED_TRANSFORMS = Shader::uniformId("instancedTransforms");
+
+		if (count == 0 || meshes.empty())
+			return;
+
+		// written straight into mapped memory when a stream has room for them, the draw then
+		// starts at their offset in the stream
+		gps::InstanceData* instances = NULL;
+		GLintptr offset = 0;
+		if (stream && (GLEW_VERSION_4_2 || GLEW_ARB_base_instance))
+			instances = (gps::InstanceData*)stream->allocate(count * sizeof(gps::InstanceData), sizeof(gps::InstanceData), offset);
+		bool streamed = instances != NULL;
+		if (!streamed) {
+			instanceData.resize(count);
+			instances = instanceData.data();
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			instances[i].model = transforms[i];
+			instances[i].normalMatrix = normalMatrices ? normalMatrices[i] : gps::ComputeNormalMatrix(transforms[i]);
+		}
+
+		GLuint baseInstance = 0;
+		if (streamed) {
+			attachInstanceBuffer(stream->getBuffer());
+			baseInstance = (GLuint)(offset / sizeof(gps::InstanceData));
+		}
+		else {
+			attachInstanceBuffer(instanceBuffer);
+			// reallocated every call so the driver never waits on the previous draw's instances
+			glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+			glBufferData(GL_ARRAY_BUFFER, count * sizeof(gps::InstanceData), instances, GL_STREAM_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+
+		shaderProgram.useShaderProgram();
+		shaderProgram.setInt(INSTANCED_TRANSFORMS, 1);
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].DrawInstanced(shaderProgram, (GLsizei)count, baseInstance);
+		shaderProgram.setInt(INSTANCED_TRANSFORMS, 0);
+	}
+
+	void Model3D::DrawInstanced(const gps::Shader& shaderProgram, const glm::mat4* transforms, size_t count, gps::StreamBuffer* stream)
+	{
+		DrawInstanced(shaderProgram, transforms, NULL, count, stream);
+	}
+
+	void Model3D::DrawInstanced(const gps::Shader& shaderProgram, const std::vector<glm::mat4>& transforms, gps::StreamBuffer* stream)
+	{
+		DrawInstanced(shaderProgram, transforms.data(), NULL, transforms.size(), stream);
+	}
+
+	void Model3D::attachInstanceBuffer(GLuint buffer)
+	{
+		if (attachedInstanceBuffer == buffer)
+			return;
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].AttachInstanceBuffer(buffer);
+		attachedInstanceBuffer = buffer;
+	}
+
 	// Does the parsing of the .obj file and fills in the data structure
-	void Model3D::ReadOBJ(std::string fileName, std::string basePath){
+	bool Model3D::ReadOBJ(std::string fileName, std::string basePath, std::vector<gps::MeshData>& meshData,
+		std::vector<std::string>* materialFiles, std::vector<gps::VertexCacheStats>* before, std::vector<gps::VertexCacheStats>* after){
 
         std::cout << "Loading : " << fileName << std::endl;
 		tinyobj::attrib_t attrib;
@@ -29,25 +190,42 @@ namespace gps {
 		std::vector<tinyobj::material_t> materials;
 		int materialId;
 
+		// mapped and parsed in parallel chunks, same structures as tinyobj::LoadObj
 		std::string err;
-		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		bool ret = gps::ObjParser::Parse(fileName, basePath, attrib, shapes, materials, err, 0, materialFiles);
 
 		if (!err.empty()) { // `err` may contain warning message.
 			std::cerr << err << std::endl;
 		}
 
+		// may run on a loader thread, so the caller reports the failure
 		if (!ret) {
-			exit(1);
+			meshData.clear();
+			return false;
 		}
 
 		std::cout << "# of shapes    : " << shapes.size() << std::endl;
 		std::cout << "# of materials : " << materials.size() << std::endl;
 
 		// Loop over shapes
+		meshData.resize(shapes.size());
+		if (before)
+			before->resize(shapes.size());
+		if (after)
+			after->resize(shapes.size());
 		for (size_t s = 0; s < shapes.size(); s++) {
-			std::vector<gps::Vertex> vertices;
-			std::vector<GLuint> indices;
-			std::vector<gps::Texture> textures;
+			std::vector<gps::Vertex>& vertices = meshData[s].vertices;
+			std::vector<GLuint>& indices = meshData[s].indices;
+			std::vector<gps::TextureRef>& textures = meshData[s].textures;
+			meshData[s].hasMaterial = false;
+			meshData[s].material.ambient = glm::vec3(0.0f);
+			meshData[s].material.diffuse = glm::vec3(0.0f);
+			meshData[s].material.specular = glm::vec3(0.0f);
+
+			// corners sharing the same index triple are welded into one vertex
+			std::unordered_map<VertexKey, GLuint, VertexKeyHash> uniqueVertices;
+			uniqueVertices.reserve(shapes[s].mesh.indices.size());
+			indices.reserve(shapes[s].mesh.indices.size());
 
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
@@ -62,12 +240,24 @@ namespace gps {
 					// access to vertex
 					tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
 
+					VertexKey key = { idx.vertex_index, idx.normal_index, idx.texcoord_index };
+					std::unordered_map<VertexKey, GLuint, VertexKeyHash>::iterator found = uniqueVertices.find(key);
+					if (found != uniqueVertices.end()) {
+						indices.push_back(found->second);
+						continue;
+					}
+
 					float vx = attrib.vertices[3 * idx.vertex_index + 0];
 					float vy = attrib.vertices[3 * idx.vertex_index + 1];
 					float vz = attrib.vertices[3 * idx.vertex_index + 2];
-					float nx = attrib.normals[3 * idx.normal_index + 0];
-					float ny = attrib.normals[3 * idx.normal_index + 1];
-					float nz = attrib.normals[3 * idx.normal_index + 2];
+					float nx = 0.0f;
+					float ny = 0.0f;
+					float nz = 0.0f;
+					if (idx.normal_index != -1) {
+						nx = attrib.normals[3 * idx.normal_index + 0];
+						ny = attrib.normals[3 * idx.normal_index + 1];
+						nz = attrib.normals[3 * idx.normal_index + 2];
+					}
 					float tx = 0.0f;
 					float ty = 0.0f;
 					if (idx.texcoord_index != -1) {
@@ -84,31 +274,38 @@ namespace gps {
 					currentVertex.Normal = vertexNormal;
 					currentVertex.TexCoords = vertexTexCoords;
 
+					GLuint newIndex = (GLuint)vertices.size();
+					uniqueVertices[key] = newIndex;
 					vertices.push_back(currentVertex);
 
-					indices.push_back(index_offset + v);
+					indices.push_back(newIndex);
 				}
 
 				index_offset += fv;
 			}
 
+			// reorder for the post-transform cache, overdraw and vertex fetch before anything is uploaded
+			gps::MeshOptimizer::Optimize(vertices, indices, before ? &(*before)[s] : NULL, after ? &(*after)[s] : NULL);
+
 			// get material id
 			// Only try to read materials if the .mtl file is present
 			int a = shapes[s].mesh.material_ids.size();
 			if (a > 0 && materials.size()>0) {
 				materialId = shapes[s].mesh.material_ids[0];
 				if (materialId != -1) {
-					gps::Material currentMaterial;
+					gps::Material& currentMaterial = meshData[s].material;
 					currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
 					currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
 					currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
+					meshData[s].hasMaterial = true;
 
 					//ambient texture
 					std::string ambientTexturePath = materials[materialId].ambient_texname;
 					if (!ambientTexturePath.empty())
 					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + ambientTexturePath, "ambientTexture");
+						gps::TextureRef currentTexture;
+						currentTexture.type = "ambientTexture";
+						currentTexture.path = ambientTexturePath;
 						textures.push_back(currentTexture);
 					}
 
@@ -116,8 +313,9 @@ namespace gps {
 					std::string diffuseTexturePath = materials[materialId].diffuse_texname;
 					if (!diffuseTexturePath.empty())
 					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + diffuseTexturePath, "diffuseTexture");
+						gps::TextureRef currentTexture;
+						currentTexture.type = "diffuseTexture";
+						currentTexture.path = diffuseTexturePath;
 						textures.push_back(currentTexture);
 					}
 
@@ -125,19 +323,50 @@ namespace gps {
 					std::string specularTexturePath = materials[materialId].specular_texname;
 					if (!specularTexturePath.empty())
 					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + specularTexturePath, "specularTexture");
+						gps::TextureRef currentTexture;
+						currentTexture.type = "specularTexture";
+						currentTexture.path = specularTexturePath;
 						textures.push_back(currentTexture);
 					}
 				}
 			}
+		}
+		return true;
+	}
+
+	// Loads the textures of each mesh and uploads the geometry to the GPU
+	void Model3D::BuildMeshes(std::vector<gps::MeshData>& meshData, std::string basePath, std::map<std::string, gps::Image>* images,
+		gps::TextureUploader* uploader) {
+
+		meshes.reserve(meshes.size() + meshData.size());
+		for (size_t m = 0; m < meshData.size(); m++) {
+			std::vector<gps::Texture> textures;
+			for (size_t t = 0; t < meshData[m].textures.size(); t++) {
+				const gps::TextureRef& ref = meshData[m].textures[t];
+				textures.push_back(LoadTexture(basePath + ref.path, ref.type, images, uploader));
+			}
+
+			meshes.emplace_back(std::move(meshData[m].vertices), std::move(meshData[m].indices), std::move(textures), vertexFormat);
+		}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+		// one identity instance up front, so the enabled instance attributes of plain draws
+		// always read from a valid buffer
+		if (!instanceBuffer) {
+			gps::InstanceData identity;
+			identity.model = glm::mat4(1.0f);
+			identity.normalMatrix = glm::mat3(1.0f);
+			glGenBuffers(1, &instanceBuffer);
+			glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(gps::InstanceData), &identity, GL_STREAM_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
 		}
+		// meshes added by this call start out unattached
+		attachedInstanceBuffer = 0;
+		attachInstanceBuffer(instanceBuffer);
 	}
 
 	// Retrieves a texture associated with the object - by its name and type
-	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
+	gps::Texture Model3D::LoadTexture(std::string path, std::string type, std::map<std::string, gps::Image>* images, gps::TextureUploader* uploader) {
 
 			for (int i = 0; i < loadedTextures.size(); i++) {
 				if (loadedTextures[i].path == path)
@@ -148,7 +377,21 @@ namespace gps {
 			}
 
 			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
+			// a path that failed to decode on a worker is not read again here
+			gps::Image* decoded = NULL;
+			if (images) {
+				std::map<std::string, gps::Image>::iterator found = images->find(path);
+				if (found != images->end())
+					decoded = &found->second;
+			}
+			if (decoded && decoded->isLoaded() && uploader) {
+				const gps::TextureDesc desc = { gps::TextureUploader::ColorFormat(decoded->getChannels(), true), GL_REPEAT };
+				currentTexture.id = uploader->enqueue(std::move(*decoded), desc);
+			}
+			else if (decoded)
+				currentTexture.id = decoded->isLoaded() ? UploadTexture(*decoded) : 0;
+			else
+				currentTexture.id = ReadTextureFromFile(path.c_str());
 			currentTexture.type = std::string(type);
 			currentTexture.path = path;
 
@@ -159,75 +402,96 @@ namespace gps {
 
 	// Reads the pixel data from an image file and loads it into the video memory
 	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
-		int x, y, n;
-		int force_channels = 4;
-		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
-		if (!image_data) {
-			fprintf(stderr, "ERROR: could not load %s\n", file_name);
+		gps::Image image;
+		if (!ReadTextureImage(file_name, image))
+			return 0;
+		return UploadTexture(image);
+	}
+
+	bool Model3D::ReadTextureImage(const std::string& fileName, gps::Image& image) {
+		if (gps::TextureCache::Read(fileName, image)) {
+			if (gps::TextureUploader::SupportsCompression(image.getCompression()))
+				return true;
+			image.Release();
+		}
+
+		// native channel count, decoded bottom row first
+		if (!image.Load(fileName, 0, true)) {
+			fprintf(stderr, "ERROR: could not load %s\n", fileName.c_str());
 			return false;
 		}
 		// NPOT check
+		int x = image.getWidth();
+		int y = image.getHeight();
 		if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
 			fprintf(
-				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name
+				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", fileName.c_str()
 			);
 		}
+		return true;
+	}
 
-		int width_in_bytes = x * 4;
-		unsigned char *top = NULL;
-		unsigned char *bottom = NULL;
-		unsigned char temp = 0;
-		int half_height = y / 2;
-
-		for (int row = 0; row < half_height; row++) {
-			top = image_data + row * width_in_bytes;
-			bottom = image_data + (y - row - 1) * width_in_bytes;
-			for (int col = 0; col < width_in_bytes; col++) {
-				temp = *top;
-				*top = *bottom;
-				*bottom = temp;
-				top++;
-				bottom++;
-			}
-		}
-
+	GLuint Model3D::UploadTexture(const gps::Image& image) {
 		GLuint textureID;
 		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_SRGB, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
-			0,
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			image_data
-		);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		RenderState::Get().bindTexture2D(0, textureID);
+		if (image.getCompression() != gps::IMAGE_UNCOMPRESSED) {
+			// cooked blocks bring every level, the GL cannot build mipmaps for them
+			GLenum format = gps::TextureUploader::CompressedFormat(image.getCompression(), true);
+			for (size_t i = 0; i < image.getLevelCount(); i++) {
+				const gps::Image::Level& level = image.getLevel(i);
+				glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, format, level.width, level.height, 0,
+					(GLsizei)level.size, image.getLevelPixels(i));
+			}
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.getLevelCount() - 1);
+		}
+		else {
+			// rows of 1 and 3 channel images are not 4 byte aligned
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexImage2D(
+				GL_TEXTURE_2D,
+				0,
+				gps::TextureUploader::ColorFormat(image.getChannels(), true),
+				image.getWidth(),
+				image.getHeight(),
+				0,
+				gps::TextureUploader::PixelFormat(image.getChannels()),
+				GL_UNSIGNED_BYTE,
+				image.getPixels()
+			);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+		gps::TextureUploader::SetGreySwizzle(image.getChannels());
 
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		RenderState::Get().bindTexture2D(0, 0);
 
 		return textureID;
 	}
 
+	// Meshes release their own buffers
 	Model3D::~Model3D() {
+        releaseTextures();
+        releaseInstanceBuffer();
+	}
+
+	void Model3D::releaseTextures() {
         for (size_t i = 0; i < loadedTextures.size(); i++) {
+            RenderState::Get().onTextureDeleted(loadedTextures.at(i).id);
             glDeleteTextures(1, &loadedTextures.at(i).id);
         }
+        loadedTextures.clear();
+	}
 
-        for (size_t i = 0; i < meshes.size(); i++) {
-            GLuint VBO = meshes.at(i).getBuffers().VBO;
-            GLuint EBO = meshes.at(i).getBuffers().EBO;
-            GLuint VAO = meshes.at(i).getBuffers().VAO;
-            glDeleteBuffers(1, &VBO);
-            glDeleteBuffers(1, &EBO);
-            glDeleteVertexArrays(1, &VAO);
+	void Model3D::releaseInstanceBuffer() {
+        // models that never loaded anything may outlive the GL context
+        if (instanceBuffer) {
+            glDeleteBuffers(1, &instanceBuffer);
+            instanceBuffer = 0;
         }
 	}
 }
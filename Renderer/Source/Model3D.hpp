@@ -1,12 +1,20 @@
 #ifndef Model3D_hpp
 #define Model3D_hpp
 
+#include "Image.hpp"
 #include "Mesh.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "ObjParser.hpp"
+#include "StreamBuffer.hpp"
+#include "TextureCache.hpp"
+#include "TextureUploader.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
 
 #include <iostream>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -16,28 +24,81 @@ namespace gps {
     {
 
     public:
+        Model3D();
         ~Model3D();
+        // Owns its meshes and textures, so it can be moved but not copied
+        Model3D(Model3D&& other) noexcept;
+        Model3D& operator=(Model3D&& other) noexcept;
+        Model3D(const Model3D&) = delete;
+        Model3D& operator=(const Model3D&) = delete;
+
+		// Vertex layout used for meshes loaded after this call
+		void SetVertexFormat(gps::VertexFormat format);
 
 		void LoadModel(std::string fileName);
 
 		void LoadModel(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram);
+		void Draw(const gps::Shader& shaderProgram) const;
+
+		// Draws one copy of the model per transform with a single instanced draw per mesh.
+		// With a created stream the instances are written into its current region, when the GL
+		// can start a draw at a base instance (4.2 or ARB_base_instance).
+		// Normal matrices are computed from the transforms unless they are passed in.
+		void DrawInstanced(const gps::Shader& shaderProgram, const glm::mat4* transforms, const glm::mat3* normalMatrices, size_t count, gps::StreamBuffer* stream = NULL);
+		void DrawInstanced(const gps::Shader& shaderProgram, const glm::mat4* transforms, size_t count, gps::StreamBuffer* stream = NULL);
+		void DrawInstanced(const gps::Shader& shaderProgram, const std::vector<glm::mat4>& transforms, gps::StreamBuffer* stream = NULL);
+
+		const std::vector<gps::Mesh>& getMeshes() const;
+
+		// Does the parsing of the .obj file and fills in the data structure, false if it could not be parsed.
+		// Needs no GL context, the result is optimized for the vertex cache but not uploaded.
+		// materialFiles, when given, receives the .mtl files the materials were read from,
+		// before and after the vertex cache statistics of each mesh around the optimization.
+		static bool ReadOBJ(std::string fileName, std::string basePath, std::vector<gps::MeshData>& meshData,
+			std::vector<std::string>* materialFiles = NULL, std::vector<gps::VertexCacheStats>* before = NULL,
+			std::vector<gps::VertexCacheStats>* after = NULL);
+
+		// Reads the meshes from the binary cache when it is up to date, otherwise parses
+		// the .obj and refreshes the cache, false if neither could be read. Needs no GL context.
+		static bool ReadModelData(const std::string& fileName, const std::string& basePath, std::vector<gps::MeshData>& meshData);
+
+		// Loads the textures of each mesh and uploads the geometry to the GPU
+		// The geometry is moved out of meshData. Textures already decoded into images,
+		// keyed by their full path, are uploaded from there instead of read again, streamed
+		// through the uploader when one is given, which moves the pixels out of images.
+		void BuildMeshes(std::vector<gps::MeshData>& meshData, std::string basePath, std::map<std::string, gps::Image>* images = NULL,
+			gps::TextureUploader* uploader = NULL);
+
+		// Reads the cooked blocks of a texture file when its cache is up to date and the GL
+		// can sample them, otherwise decodes the file with its own channel count. Rows come bottom first.
+		// Needs no GL context, only the extension flags.
+		static bool ReadTextureImage(const std::string& fileName, gps::Image& image);
+		// Uploads pixels or cooked blocks as a mipmapped sRGB texture
+		static GLuint UploadTexture(const gps::Image& image);
 
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
 		// Associated textures
         std::vector<gps::Texture> loadedTextures;
-
-		// Does the parsing of the .obj file and fills in the data structure
-		void ReadOBJ(std::string fileName, std::string basePath);
+		// Layout the meshes are uploaded with
+		gps::VertexFormat vertexFormat;
+		// InstanceData of the last DrawInstanced without a stream, shared by all meshes
+		GLuint instanceBuffer;
+		// buffer the meshes' instance attributes currently read from
+		GLuint attachedInstanceBuffer;
+		std::vector<gps::InstanceData> instanceData;
 
 		// Retrieves a texture associated with the object - by its name and type
-		gps::Texture LoadTexture(std::string path, std::string type);
+		gps::Texture LoadTexture(std::string path, std::string type, std::map<std::string, gps::Image>* images, gps::TextureUploader* uploader);
 
 		// Reads the pixel data from an image file and loads it into the video memory
 		GLuint ReadTextureFromFile(const char* file_name);
+
+		void releaseTextures();
+		void releaseInstanceBuffer();
+		void attachInstanceBuffer(GLuint buffer);
     };
 }
 
@@ -0,0 +1,439 @@
+#include "ObjParser.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <utility>
+
+namespace gps {
+
+    namespace {
+
+        const double POWERS_OF_TEN[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+        const int MAX_FAST_EXPONENT = 22;
+        const int MAX_MANTISSA_DIGITS = 19;
+        // doubles hold every integer up to 2^53 exactly
+        const uint64_t MAX_EXACT_MANTISSA = (uint64_t)1 << 53;
+
+        // flags of the corner components given relative to the end of the chunk
+        const unsigned char RELATIVE_POSITION = 1;
+        const unsigned char RELATIVE_TEXCOORD = 2;
+        const unsigned char RELATIVE_NORMAL = 4;
+
+        enum EventType {
+            EVENT_MATERIAL,
+            EVENT_SHAPE
+        };
+
+        // usemtl, g and o lines, applied before the face they precede
+        struct Event {
+            size_t face;
+            EventType type;
+            std::string name;
+        };
+
+        struct RelativeCorner {
+            size_t corner;
+            unsigned char components;
+        };
+
+        // Everything parsed from one line-aligned range of the file. Corner indices are
+        // 0-based; negative OBJ indices resolve against the chunk's own attribute counts
+        // and get the preceding chunks' counts added when merging.
+        struct Chunk {
+            const char* begin;
+            const char* end;
+            std::vector<float> positions;
+            std::vector<float> normals;
+            std::vector<float> texcoords;
+            std::vector<tinyobj::index_t> corners;
+            std::vector<uint32_t> faceSizes;
+            std::vector<RelativeCorner> relativeCorners;
+            std::vector<Event> events;
+            std::vector<std::string> libraries;
+        };
+
+        inline bool isSpace(char c)
+        {
+            return c == ' ' || c == '\t';
+        }
+
+        inline bool isDigit(char c)
+        {
+            return c >= '0' && c <= '9';
+        }
+
+        inline const char* skipSpaces(const char* p, const char* end)
+        {
+            while (p < end && isSpace(*p))
+                p++;
+            return p;
+        }
+
+        inline const char* skipToken(const char* p, const char* end)
+        {
+            while (p < end && !isSpace(*p))
+                p++;
+            return p;
+        }
+
+        // First whitespace separated word after p
+        std::string readName(const char* p, const char* end)
+        {
+            p = skipSpaces(p, end);
+            return std::string(p, skipToken(p, end));
+        }
+
+        bool startsWith(const char* p, const char* end, const char* keyword, size_t length)
+        {
+            return (size_t)(end - p) > length && memcmp(p, keyword, length) == 0 && isSpace(p[length]);
+        }
+
+        void parseFloats(const char* p, const char* end, std::vector<float>& values, int count)
+        {
+            for (int i = 0; i < count; i++) {
+                p = skipSpaces(p, end);
+                float value = 0.0f;
+                const char* next = ParseFloat(p, end, value);
+                values.push_back(value);
+                p = next == p ? skipToken(p, end) : next;
+            }
+        }
+
+        int parseInt(const char*& p, const char* end)
+        {
+            bool negative = false;
+            if (p < end && (*p == '-' || *p == '+')) {
+                negative = *p == '-';
+                p++;
+            }
+            int value = 0;
+            while (p < end && isDigit(*p))
+                value = value * 10 + (*p++ - '0');
+            return negative ? -value : value;
+        }
+
+        // Same rules as tinyobj: 1-based, 0 kept as 0, negative counts back from count
+        inline int fixIndex(int index, int count, unsigned char flag, unsigned char& relative)
+        {
+            if (index > 0)
+                return index - 1;
+            if (index == 0)
+                return 0;
+            relative |= flag;
+            return count + index;
+        }
+
+        void parseFace(Chunk& chunk, const char* p, const char* end)
+        {
+            int positionCount = (int)(chunk.positions.size() / 3);
+            int texcoordCount = (int)(chunk.texcoords.size() / 2);
+            int normalCount = (int)(chunk.normals.size() / 3);
+            size_t first = chunk.corners.size();
+            size_t firstRelative = chunk.relativeCorners.size();
+
+            for (;;) {
+                p = skipSpaces(p, end);
+                if (p == end)
+                    break;
+
+                tinyobj::index_t corner;
+                corner.texcoord_index = -1;
+                corner.normal_index = -1;
+                unsigned char relative = 0;
+                corner.vertex_index = fixIndex(parseInt(p, end), positionCount, RELATIVE_POSITION, relative);
+                if (p < end && *p == '/') {
+                    p++;
+                    // v//vn has no texcoord
+                    if (p < end && *p != '/')
+                        corner.texcoord_index = fixIndex(parseInt(p, end), texcoordCount, RELATIVE_TEXCOORD, relative);
+                    if (p < end && *p == '/') {
+                        p++;
+                        corner.normal_index = fixIndex(parseInt(p, end), normalCount, RELATIVE_NORMAL, relative);
+                    }
+                }
+                p = skipToken(p, end);
+
+                if (relative) {
+                    RelativeCorner record = { chunk.corners.size(), relative };
+                    chunk.relativeCorners.push_back(record);
+                }
+                chunk.corners.push_back(corner);
+            }
+
+            // points and lines are not faces
+            size_t count = chunk.corners.size() - first;
+            if (count < 3) {
+                chunk.corners.resize(first);
+                chunk.relativeCorners.resize(firstRelative);
+                return;
+            }
+            chunk.faceSizes.push_back((uint32_t)count);
+        }
+
+        void parseLine(Chunk& chunk, const char* p, const char* end)
+        {
+            p = skipSpaces(p, end);
+            if (end - p < 2 || *p == '#')
+                return;
+
+            if (p[0] == 'v') {
+                if (isSpace(p[1]))
+                    parseFloats(p + 2, end, chunk.positions, 3);
+                else if (p[1] == 'n' && end - p > 2 && isSpace(p[2]))
+                    parseFloats(p + 3, end, chunk.normals, 3);
+                else if (p[1] == 't' && end - p > 2 && isSpace(p[2]))
+                    parseFloats(p + 3, end, chunk.texcoords, 2);
+            } else if (p[0] == 'f' && isSpace(p[1])) {
+                parseFace(chunk, p + 2, end);
+            } else if ((p[0] == 'g' || p[0] == 'o') && isSpace(p[1])) {
+                Event event = { chunk.faceSizes.size(), EVENT_SHAPE, readName(p + 2, end) };
+                chunk.events.push_back(event);
+            } else if (startsWith(p, end, "usemtl", 6)) {
+                Event event = { chunk.faceSizes.size(), EVENT_MATERIAL, readName(p + 7, end) };
+                chunk.events.push_back(event);
+            } else if (startsWith(p, end, "mtllib", 6)) {
+                chunk.libraries.push_back(readName(p + 7, end));
+            }
+        }
+
+        void parseChunk(Chunk& chunk)
+        {
+            const char* p = chunk.begin;
+            while (p < chunk.end) {
+                const char* lineEnd = (const char*)memchr(p, '\n', chunk.end - p);
+                const char* next = lineEnd ? lineEnd + 1 : chunk.end;
+                if (!lineEnd)
+                    lineEnd = chunk.end;
+                if (lineEnd > p && lineEnd[-1] == '\r')
+                    lineEnd--;
+                parseLine(chunk, p, lineEnd);
+                p = next;
+            }
+        }
+
+        // Start of the line after the one containing p
+        const char* nextLine(const char* p, const char* end)
+        {
+            const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+            return lineEnd ? lineEnd + 1 : end;
+        }
+
+        void flushShape(tinyobj::shape_t& shape, const std::string& name, std::vector<tinyobj::shape_t>& shapes)
+        {
+            if (!shape.mesh.indices.empty()) {
+                shape.name = name;
+                shapes.push_back(tinyobj::shape_t());
+                std::swap(shapes.back(), shape);
+            }
+            shape = tinyobj::shape_t();
+        }
+    }
+
+    const char* ParseFloat(const char* begin, const char* end, float& value)
+    {
+        const char* p = begin;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            p++;
+        }
+
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        bool truncated = false;
+        bool any = false;
+        for (; p < end && isDigit(*p); p++) {
+            any = true;
+            if (digits < MAX_MANTISSA_DIGITS) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa != 0)
+                    digits++;
+            } else {
+                exponent++;
+                truncated = truncated || *p != '0';
+            }
+        }
+        if (p < end && *p == '.') {
+            for (p++; p < end && isDigit(*p); p++) {
+                any = true;
+                if (digits < MAX_MANTISSA_DIGITS) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    if (mantissa != 0)
+                        digits++;
+                    exponent--;
+                } else {
+                    truncated = truncated || *p != '0';
+                }
+            }
+        }
+        if (!any)
+            return begin;
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            const char* q = p + 1;
+            bool negativeExponent = false;
+            if (q < end && (*q == '-' || *q == '+')) {
+                negativeExponent = *q == '-';
+                q++;
+            }
+            if (q < end && isDigit(*q)) {
+                int written = 0;
+                for (; q < end && isDigit(*q); q++) {
+                    if (written < 10000)
+                        written = written * 10 + (*q - '0');
+                }
+                exponent += negativeExponent ? -written : written;
+                p = q;
+            }
+        }
+
+        // both the mantissa and the power of ten are exact doubles, so one
+        // multiplication or division rounds correctly
+        if (!truncated && mantissa <= MAX_EXACT_MANTISSA && exponent >= -MAX_FAST_EXPONENT && exponent <= MAX_FAST_EXPONENT) {
+            double result = (double)mantissa;
+            result = exponent < 0 ? result / POWERS_OF_TEN[-exponent] : result * POWERS_OF_TEN[exponent];
+            value = (float)(negative ? -result : result);
+            return p;
+        }
+
+        std::string text(begin, p);
+        value = (float)strtod(text.c_str(), NULL);
+        return p;
+    }
+
+    bool ObjParser::Parse(const std::string& fileName, const std::string& basePath,
+        tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes,
+        std::vector<tinyobj::material_t>& materials, std::string& err, unsigned threadCount,
+        std::vector<std::string>* materialFiles)
+    {
+        attrib.vertices.clear();
+        attrib.normals.clear();
+        attrib.texcoords.clear();
+        shapes.clear();
+
+        MappedFile file;
+        if (!file.Open(fileName)) {
+            err += "Cannot open file [" + fileName + "]\n";
+            return false;
+        }
+        const char* data = (const char*)file.getData();
+        const char* dataEnd = data + file.getSize();
+
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        size_t chunkCount = std::min<size_t>(threadCount, std::max<size_t>(1, file.getSize() / MIN_CHUNK_SIZE));
+
+        // chunk boundaries move forward to the next line start
+        std::vector<Chunk> chunks(chunkCount);
+        const char* begin = data;
+        for (size_t i = 0; i < chunkCount; i++) {
+            const char* end = dataEnd;
+            if (i + 1 < chunkCount) {
+                end = data + file.getSize() / chunkCount * (i + 1);
+                end = end > begin ? nextLine(end - 1, dataEnd) : begin;
+            }
+            chunks[i].begin = begin;
+            chunks[i].end = end;
+            begin = end;
+        }
+
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < chunkCount; i++)
+            workers.push_back(std::thread(parseChunk, std::ref(chunks[i])));
+        parseChunk(chunks[0]);
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+
+        // materials from every mtllib, in file order
+        std::map<std::string, int> materialMap;
+        tinyobj::MaterialFileReader materialReader(basePath);
+        for (size_t c = 0; c < chunkCount; c++) {
+            for (size_t l = 0; l < chunks[c].libraries.size(); l++) {
+                if (materialFiles)
+                    materialFiles->push_back(basePath + chunks[c].libraries[l]);
+                std::string materialErr;
+                bool ok = materialReader(chunks[c].libraries[l], &materials, &materialMap, &materialErr);
+                err += materialErr;
+                if (!ok)
+                    return false;
+            }
+        }
+
+        size_t positionFloats = 0, normalFloats = 0, texcoordFloats = 0;
+        for (size_t c = 0; c < chunkCount; c++) {
+            positionFloats += chunks[c].positions.size();
+            normalFloats += chunks[c].normals.size();
+            texcoordFloats += chunks[c].texcoords.size();
+        }
+        attrib.vertices.reserve(positionFloats);
+        attrib.normals.reserve(normalFloats);
+        attrib.texcoords.reserve(texcoordFloats);
+
+        tinyobj::shape_t shape;
+        std::string name;
+        int material = -1;
+        for (size_t c = 0; c < chunkCount; c++) {
+            Chunk& chunk = chunks[c];
+            int positionOffset = (int)(attrib.vertices.size() / 3);
+            int texcoordOffset = (int)(attrib.texcoords.size() / 2);
+            int normalOffset = (int)(attrib.normals.size() / 3);
+            attrib.vertices.insert(attrib.vertices.end(), chunk.positions.begin(), chunk.positions.end());
+            attrib.normals.insert(attrib.normals.end(), chunk.normals.begin(), chunk.normals.end());
+            attrib.texcoords.insert(attrib.texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+            std::vector<float>().swap(chunk.positions);
+            std::vector<float>().swap(chunk.normals);
+            std::vector<float>().swap(chunk.texcoords);
+
+            for (size_t i = 0; i < chunk.relativeCorners.size(); i++) {
+                tinyobj::index_t& corner = chunk.corners[chunk.relativeCorners[i].corner];
+                unsigned char components = chunk.relativeCorners[i].components;
+                if (components & RELATIVE_POSITION)
+                    corner.vertex_index += positionOffset;
+                if (components & RELATIVE_TEXCOORD)
+                    corner.texcoord_index += texcoordOffset;
+                if (components & RELATIVE_NORMAL)
+                    corner.normal_index += normalOffset;
+            }
+
+            size_t corner = 0;
+            size_t event = 0;
+            for (size_t f = 0; f <= chunk.faceSizes.size(); f++) {
+                for (; event < chunk.events.size() && chunk.events[event].face == f; event++) {
+                    const Event& current = chunk.events[event];
+                    if (current.type == EVENT_SHAPE) {
+                        flushShape(shape, name, shapes);
+                        name = current.name;
+                    } else {
+                        std::map<std::string, int>::const_iterator found = materialMap.find(current.name);
+                        material = found != materialMap.end() ? found->second : -1;
+                    }
+                }
+                if (f == chunk.faceSizes.size())
+                    break;
+
+                // triangle fan around the first corner
+                uint32_t count = chunk.faceSizes[f];
+                for (uint32_t k = 2; k < count; k++) {
+                    shape.mesh.indices.push_back(chunk.corners[corner]);
+                    shape.mesh.indices.push_back(chunk.corners[corner + k - 1]);
+                    shape.mesh.indices.push_back(chunk.corners[corner + k]);
+                    shape.mesh.num_face_vertices.push_back(3);
+                    shape.mesh.material_ids.push_back(material);
+                }
+                corner += count;
+            }
+            std::vector<tinyobj::index_t>().swap(chunk.corners);
+        }
+        flushShape(shape, name, shapes);
+        return true;
+    }
+}
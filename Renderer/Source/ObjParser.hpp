@@ -0,0 +1,35 @@
+#ifndef ObjParser_hpp
+#define ObjParser_hpp
+
+#include "tiny_obj_loader.h"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Wavefront .obj parser for large files. The file is memory mapped and split into
+    // line-aligned chunks parsed on their own threads, then the chunks are merged in
+    // file order into tinyobj's structures, faces triangulated as fans like
+    // tinyobj::LoadObj does. Materials are read with tinyobj's mtl reader.
+    class ObjParser
+    {
+    public:
+        // files are not split into chunks smaller than this
+        static const size_t MIN_CHUNK_SIZE = 4 * 1024 * 1024;
+
+        // threadCount 0 uses every hardware thread. err collects warnings too.
+        // materialFiles, when given, receives the path of every mtllib read, in file order.
+        static bool Parse(const std::string& fileName, const std::string& basePath,
+            tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes,
+            std::vector<tinyobj::material_t>& materials, std::string& err, unsigned threadCount = 0,
+            std::vector<std::string>* materialFiles = NULL);
+    };
+
+    // Parses the decimal number at the start of [begin, end), returns where it stopped,
+    // begin when there was no number. Exact for up to 19 significant digits and powers
+    // of ten up to 22, longer numbers go through strtod.
+    const char* ParseFloat(const char* begin, const char* end, float& value);
+}
+
+#endif /* ObjParser_hpp */
@@ -0,0 +1,152 @@
+#include "ProgramCache.hpp"
+#include "MappedFile.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace gps {
+
+    namespace {
+
+        const char CACHE_MAGIC[4] = { 'G', 'P', 'S', 'P' };
+        const uint64_t FNV_OFFSET = 14695981039346656037ull;
+        const uint64_t FNV_PRIME = 1099511628211ull;
+
+        struct FileHeader {
+            char magic[4];
+            uint32_t version;
+            uint64_t key;
+            uint32_t binaryFormat;
+            uint32_t padding;
+            uint64_t binarySize;
+        };
+
+        // FNV-1a, strings are separated so "ab" + "c" and "a" + "bc" differ
+        uint64_t hashString(uint64_t hash, const char* text, size_t length)
+        {
+            for (size_t i = 0; i < length; i++) {
+                hash ^= (unsigned char)text[i];
+                hash *= FNV_PRIME;
+            }
+            hash ^= 0xFF;
+            return hash * FNV_PRIME;
+        }
+
+        uint64_t hashGLString(uint64_t hash, GLenum name)
+        {
+            const char* value = (const char*)glGetString(name);
+            return value ? hashString(hash, value, strlen(value)) : hashString(hash, "", 0);
+        }
+    }
+
+    bool ProgramCache::IsSupported()
+    {
+        if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+            return false;
+        // some drivers expose the entry points without any binary format
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        return formatCount > 0;
+    }
+
+    uint64_t ProgramCache::ComputeKey(const std::string& vertexSource, const std::string& fragmentSource, const std::string& defines)
+    {
+        uint64_t hash = FNV_OFFSET;
+        hash = hashString(hash, vertexSource.data(), vertexSource.size());
+        hash = hashString(hash, fragmentSource.data(), fragmentSource.size());
+        hash = hashString(hash, defines.data(), defines.size());
+        hash = hashGLString(hash, GL_VENDOR);
+        hash = hashGLString(hash, GL_RENDERER);
+        hash = hashGLString(hash, GL_VERSION);
+        return hash;
+    }
+
+    std::string ProgramCache::GetCachePath(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName,
+        const std::string& defines)
+    {
+        uint64_t program = hashString(FNV_OFFSET, fragmentShaderFileName.data(), fragmentShaderFileName.size());
+        program = hashString(program, defines.data(), defines.size());
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)program);
+        return vertexShaderFileName + "." + hex + ".progbin";
+    }
+
+    GLuint ProgramCache::Read(const std::string& path, uint64_t key)
+    {
+        MappedFile file;
+        if (!file.Open(path))
+            return 0;
+
+        const unsigned char* data = file.getData();
+        uint64_t size = file.getSize();
+        if (size < sizeof(FileHeader))
+            return 0;
+
+        FileHeader header;
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+            header.version != VERSION ||
+            header.key != key ||
+            header.binarySize != size - sizeof(FileHeader)) {
+            return 0;
+        }
+
+        // the driver may still refuse a binary, e.g. after an update that kept its version string
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, (GLenum)header.binaryFormat, data + sizeof(FileHeader), (GLsizei)header.binarySize);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    bool ProgramCache::Write(const std::string& path, uint64_t key, GLuint program)
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return false;
+
+        std::vector<unsigned char> binary((size_t)length);
+        GLenum binaryFormat = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &binaryFormat, binary.data());
+        if (written <= 0)
+            return false;
+
+        FileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.version = VERSION;
+        header.key = key;
+        header.binaryFormat = binaryFormat;
+        header.binarySize = (uint64_t)written;
+
+        // write to a temporary file first so a crash never leaves a half written cache behind
+        std::string tempPath = path + ".tmp";
+        std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)binary.data(), written);
+        out.close();
+
+        if (!out) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+
+        std::remove(path.c_str());
+        if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef ProgramCache_hpp
+#define ProgramCache_hpp
+
+#include <GLEW/glew.h>
+
+#include <cstdint>
+#include <string>
+
+namespace gps {
+
+    // Binary cache of linked programs written next to the vertex shader as
+    // "<vertex shader>.<program>.progbin", one file per fragment shader and define set,
+    // holding what glGetProgramBinary returned. The key stored inside hashes both sources,
+    // the defines and the GL vendor, renderer and version, so an edited shader or another
+    // driver misses the cache, compiles from source and rewrites the file.
+    // Needs GL 4.1 or ARB_get_program_binary, see IsSupported().
+    class ProgramCache
+    {
+    public:
+        static const uint32_t VERSION = 1;
+
+        static bool IsSupported();
+
+        // Needs a current context for the driver strings
+        static uint64_t ComputeKey(const std::string& vertexSource, const std::string& fragmentSource, const std::string& defines);
+        static std::string GetCachePath(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName,
+            const std::string& defines);
+
+        // Creates a program from the cached binary, 0 if missing, stale or rejected by the driver
+        static GLuint Read(const std::string& path, uint64_t key);
+
+        // Stores the binary of a linked program, which must have been linked with
+        // GL_PROGRAM_BINARY_RETRIEVABLE_HINT set. False if it could not be written.
+        static bool Write(const std::string& path, uint64_t key, GLuint program);
+    };
+}
+
+#endif /* ProgramCache_hpp */
@@ -0,0 +1,193 @@
+#include "RenderQueue.hpp"
+
+#include <cstring>
+
+namespace gps {
+
+    namespace {
+
+        // Top 16 bits of a non-negative float keep its order: sign, exponent and 7 mantissa bits
+        uint64_t quantizeDepth(float depth)
+        {
+            if (!(depth > 0.0f))
+                return 0;
+            uint32_t bits;
+            memcpy(&bits, &depth, sizeof(bits));
+            return bits >> 16;
+        }
+    }
+
+    const float RenderQueue::REBUILD_COST_RATIO = 1.5f;
+
+    RenderQueue::RenderQueue()
+        : builtCost(0.0f), hierarchyDirty(false)
+    {
+    }
+
+    void RenderQueue::clear()
+    {
+        items.clear();
+        bounds.clear();
+        boxes.clear();
+        hierarchyDirty = true;
+    }
+
+    void RenderQueue::add(const Mesh& mesh, const glm::mat4& model, const glm::mat3& normalMatrix)
+    {
+        DrawItem item;
+        item.mesh = &mesh;
+        item.model = model;
+        item.normalMatrix = normalMatrix;
+        TransformBox(model, mesh.getBoundsMin(), mesh.getBoundsMax(), item.center, item.extents);
+        items.push_back(item);
+        bounds.add(item.center, item.extents);
+
+        Aabb box;
+        box.lower = item.center - item.extents;
+        box.upper = item.center + item.extents;
+        boxes.push_back(box);
+        hierarchyDirty = true;
+    }
+
+    void RenderQueue::add(const Model3D& model, const glm::mat4& transform, const glm::mat3& normalMatrix)
+    {
+        const std::vector<Mesh>& meshes = model.getMeshes();
+        for (size_t i = 0; i < meshes.size(); i++)
+            add(meshes[i], transform, normalMatrix);
+    }
+
+    uint64_t RenderQueue::MakeKey(unsigned pass, GLuint program, GLuint textureSet, GLuint vertexArray, float depth)
+    {
+        return ((uint64_t)(pass & 0xF) << 60) |
+            ((uint64_t)(program & 0xFFF) << 48) |
+            ((uint64_t)(textureSet & 0xFFFF) << 32) |
+            ((uint64_t)(vertexArray & 0xFFFF) << 16) |
+            quantizeDepth(depth);
+    }
+
+    void RenderQueue::sort(unsigned pass, const Shader& shader, const glm::mat4& view, const Frustum* frustum)
+    {
+        if (frustum && items.size() >= HIERARCHY_MIN_ITEMS) {
+            updateHierarchy();
+            hierarchy.cull(*frustum, visible);
+        }
+        else if (frustum)
+            bounds.cull(*frustum, visible);
+        else
+            visible.assign(items.size(), 1);
+
+        entries.clear();
+        for (size_t i = 0; i < items.size(); i++) {
+            if (!visible[i])
+                continue;
+            const DrawItem& item = items[i];
+            // the camera looks down -z in view space
+            float depth = -(view * glm::vec4(item.center, 1.0f)).z;
+            SortEntry entry;
+            entry.key = MakeKey(pass, shader.shaderProgram, item.mesh->getTextureSetKey(),
+                item.mesh->getVertexArray(), depth);
+            entry.item = (uint32_t)i;
+            entries.push_back(entry);
+        }
+        RadixSort(entries, scratch);
+    }
+
+    void RenderQueue::submit(const Shader& shader, UniformId modelUniform, UniformId normalMatrixUniform) const
+    {
+        shader.useShaderProgram();
+        for (size_t i = 0; i < entries.size(); i++) {
+            const DrawItem& item = items[entries[i].item];
+            shader.setMat4(modelUniform, item.model);
+            shader.setMat3(normalMatrixUniform, item.normalMatrix);
+            item.mesh->Draw(shader);
+        }
+    }
+
+    size_t RenderQueue::size() const
+    {
+        return items.size();
+    }
+
+    size_t RenderQueue::getSortedCount() const
+    {
+        return entries.size();
+    }
+
+    size_t RenderQueue::getCulledCount() const
+    {
+        return items.size() - entries.size();
+    }
+
+    const DrawItem& RenderQueue::getSortedItem(size_t i) const
+    {
+        return items[entries[i].item];
+    }
+
+    const DrawItem* RenderQueue::pick(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance)
+    {
+        updateHierarchy();
+        uint32_t item;
+        if (!hierarchy.intersectRay(origin, direction, maxDistance, item, distance))
+            return NULL;
+        return &items[item];
+    }
+
+    void RenderQueue::updateHierarchy()
+    {
+        if (!hierarchyDirty)
+            return;
+        hierarchyDirty = false;
+
+        if (hierarchy.getPrimitiveCount() == boxes.size()) {
+            hierarchy.refit(boxes);
+            if (hierarchy.getCost() <= builtCost * REBUILD_COST_RATIO)
+                return;
+        }
+        hierarchy.build(boxes);
+        builtCost = hierarchy.getCost();
+    }
+
+    void RenderQueue::RadixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch)
+    {
+        size_t count = entries.size();
+        if (count < 2)
+            return;
+        scratch.resize(count);
+
+        // all eight histograms in one read of the keys
+        size_t histograms[8][256];
+        memset(histograms, 0, sizeof(histograms));
+        for (size_t i = 0; i < count; i++) {
+            uint64_t key = entries[i].key;
+            for (int byte = 0; byte < 8; byte++)
+                histograms[byte][(key >> (byte * 8)) & 0xFF]++;
+        }
+
+        SortEntry* source = entries.data();
+        SortEntry* destination = scratch.data();
+        for (int byte = 0; byte < 8; byte++) {
+            size_t* histogram = histograms[byte];
+
+            // a byte shared by every key would only copy the array
+            if (histogram[(source[0].key >> (byte * 8)) & 0xFF] == count)
+                continue;
+
+            size_t offset = 0;
+            for (int bucket = 0; bucket < 256; bucket++) {
+                size_t bucketSize = histogram[bucket];
+                histogram[bucket] = offset;
+                offset += bucketSize;
+            }
+
+            for (size_t i = 0; i < count; i++)
+                destination[histogram[(source[i].key >> (byte * 8)) & 0xFF]++] = source[i];
+
+            SortEntry* swap = source;
+            source = destination;
+            destination = swap;
+        }
+
+        if (source != entries.data())
+            entries.swap(scratch);
+    }
+}
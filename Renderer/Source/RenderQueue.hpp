@@ -0,0 +1,96 @@
+#ifndef RenderQueue_hpp
+#define RenderQueue_hpp
+
+#include "Bvh.hpp"
+#include "Frustum.hpp"
+#include "Model3D.hpp"
+#include "Shader.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // One mesh instance collected for the frame
+    struct DrawItem
+    {
+        const Mesh* mesh;
+        glm::mat4 model;
+        glm::mat3 normalMatrix;
+        // world space AABB of the mesh, the center is also used for depth sorting
+        glm::vec3 center;
+        glm::vec3 extents;
+    };
+
+    // Collects the frame's draws once, then sorts them per pass by a packed 64-bit key
+    // so submission changes program, textures and VAO as rarely as possible.
+    // Key layout, most significant first:
+    //   pass 4 | shader 12 | texture set 16 | vertex array 16 | depth 16
+    class RenderQueue
+    {
+    public:
+        // below this many items the flat SIMD loop beats walking the hierarchy
+        static const size_t HIERARCHY_MIN_ITEMS = 64;
+        // refits that loosen the tree past this SAH cost ratio trigger a rebuild
+        static const float REBUILD_COST_RATIO;
+
+        RenderQueue();
+
+        void clear();
+
+        void add(const Mesh& mesh, const glm::mat4& model, const glm::mat3& normalMatrix);
+        // Adds every mesh of the model
+        void add(const Model3D& model, const glm::mat4& transform, const glm::mat3& normalMatrix);
+
+        // Builds the keys of one pass over the collected items and radix-sorts them.
+        // Depth is the view space distance of each item's center, sorted front to back.
+        // With a frustum, items whose bounds lie outside it are left out of the pass.
+        void sort(unsigned pass, const Shader& shader, const glm::mat4& view, const Frustum* frustum = NULL);
+
+        // Draws the items in the order of the last sort()
+        void submit(const Shader& shader, UniformId modelUniform, UniformId normalMatrixUniform) const;
+
+        size_t size() const;
+        // Items kept by the last sort() and the i-th of them in sorted order
+        size_t getSortedCount() const;
+        const DrawItem& getSortedItem(size_t i) const;
+        size_t getCulledCount() const;
+
+        // Nearest item whose world bounds the ray hits, NULL if none
+        const DrawItem* pick(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance);
+
+        static uint64_t MakeKey(unsigned pass, GLuint program, GLuint textureSet, GLuint vertexArray, float depth);
+
+    private:
+        struct SortEntry
+        {
+            uint64_t key;
+            uint32_t item;
+        };
+
+        std::vector<DrawItem> items;
+        // the items' world bounds again, laid out for the culling loop
+        BoxSet bounds;
+        std::vector<uint8_t> visible;
+        // Refitted from the same boxes once per frame while the item count holds,
+        // items are expected to be added in the same order every frame
+        Bvh hierarchy;
+        std::vector<Aabb> boxes;
+        float builtCost;
+        bool hierarchyDirty;
+        // reused every frame so sorting does not allocate once the queue is warm
+        std::vector<SortEntry> entries;
+        std::vector<SortEntry> scratch;
+
+        // Refits the hierarchy to this frame's boxes, rebuilding it when the item count
+        // changed or refitting has made it too costly
+        void updateHierarchy();
+
+        // LSD radix sort on the key, 8 bits per pass, skipping bytes every key shares
+        static void RadixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch);
+    };
+}
+
+#endif /* RenderQueue_hpp */
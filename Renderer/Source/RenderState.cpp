@@ -0,0 +1,179 @@
+#include "RenderState.hpp"
+
+#include <cstring>
+
+namespace gps {
+
+    namespace {
+        // never a valid GL name or enum, marks a binding as unknown
+        const GLuint UNKNOWN = 0xFFFFFFFFu;
+    }
+
+    unsigned RenderStateStats::totalIssued() const
+    {
+        unsigned total = 0;
+        for (int i = 0; i < STATE_COUNTER_COUNT; i++)
+            total += issued[i];
+        return total;
+    }
+
+    unsigned RenderStateStats::totalElided() const
+    {
+        unsigned total = 0;
+        for (int i = 0; i < STATE_COUNTER_COUNT; i++)
+            total += elided[i];
+        return total;
+    }
+
+    RenderState& RenderState::Get()
+    {
+        static RenderState instance;
+        return instance;
+    }
+
+    RenderState::RenderState()
+    {
+        invalidate();
+        resetStats();
+    }
+
+    bool RenderState::filter(bool redundant, RenderStateCounter counter)
+    {
+        if (redundant) {
+            stats.elided[counter]++;
+            return true;
+        }
+        stats.issued[counter]++;
+        return false;
+    }
+
+    void RenderState::useProgram(GLuint program)
+    {
+        if (filter(this->program == program, STATE_PROGRAM))
+            return;
+        glUseProgram(program);
+        this->program = program;
+    }
+
+    void RenderState::bindVertexArray(GLuint vertexArray)
+    {
+        if (filter(this->vertexArray == vertexArray, STATE_VERTEX_ARRAY))
+            return;
+        glBindVertexArray(vertexArray);
+        this->vertexArray = vertexArray;
+    }
+
+    void RenderState::bindTexture2D(GLuint unit, GLuint texture)
+    {
+        if (unit >= MAX_TEXTURE_UNITS) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            activeTextureUnit = unit;
+            return;
+        }
+
+        // the unit is made active even when the bind is redundant, callers that bind
+        // a texture to modify it rely on it being the one GL_TEXTURE_2D edits reach
+        if (!filter(activeTextureUnit == unit, STATE_ACTIVE_TEXTURE)) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeTextureUnit = unit;
+        }
+        if (filter(textures[unit] == texture, STATE_TEXTURE))
+            return;
+
+        glBindTexture(GL_TEXTURE_2D, texture);
+        textures[unit] = texture;
+    }
+
+    void RenderState::polygonMode(GLenum mode)
+    {
+        if (filter(polygonModeValue == mode, STATE_POLYGON_MODE))
+            return;
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+        polygonModeValue = mode;
+    }
+
+    void RenderState::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        bool redundant = viewportValue[0] == x && viewportValue[1] == y &&
+            viewportValue[2] == width && viewportValue[3] == height;
+        if (filter(redundant, STATE_VIEWPORT))
+            return;
+        glViewport(x, y, width, height);
+        viewportValue[0] = x;
+        viewportValue[1] = y;
+        viewportValue[2] = width;
+        viewportValue[3] = height;
+    }
+
+    void RenderState::bindFramebuffer(GLuint framebuffer)
+    {
+        if (filter(this->framebuffer == framebuffer, STATE_FRAMEBUFFER))
+            return;
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        this->framebuffer = framebuffer;
+    }
+
+    void RenderState::onProgramDeleted(GLuint program)
+    {
+        if (this->program == program)
+            this->program = UNKNOWN;
+    }
+
+    void RenderState::onVertexArrayDeleted(GLuint vertexArray)
+    {
+        if (this->vertexArray == vertexArray)
+            this->vertexArray = UNKNOWN;
+    }
+
+    void RenderState::onTextureDeleted(GLuint texture)
+    {
+        for (GLuint unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+            if (textures[unit] == texture)
+                textures[unit] = UNKNOWN;
+        }
+    }
+
+    void RenderState::onFramebufferDeleted(GLuint framebuffer)
+    {
+        if (this->framebuffer == framebuffer)
+            this->framebuffer = UNKNOWN;
+    }
+
+    void RenderState::invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeTextureUnit = UNKNOWN;
+        for (GLuint unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+            textures[unit] = UNKNOWN;
+        polygonModeValue = UNKNOWN;
+        viewportValue[0] = viewportValue[1] = -1;
+        viewportValue[2] = viewportValue[3] = -1;
+        framebuffer = UNKNOWN;
+    }
+
+    const RenderStateStats& RenderState::getStats() const
+    {
+        return stats;
+    }
+
+    void RenderState::resetStats()
+    {
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    const char* RenderState::getCounterName(RenderStateCounter counter)
+    {
+        switch (counter) {
+        case STATE_PROGRAM: return "program";
+        case STATE_VERTEX_ARRAY: return "vertex_array";
+        case STATE_ACTIVE_TEXTURE: return "active_texture";
+        case STATE_TEXTURE: return "texture";
+        case STATE_POLYGON_MODE: return "polygon_mode";
+        case STATE_VIEWPORT: return "viewport";
+        case STATE_FRAMEBUFFER: return "framebuffer";
+        default: return "unknown";
+        }
+    }
+}
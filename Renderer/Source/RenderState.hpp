@@ -0,0 +1,76 @@
+#ifndef RenderState_hpp
+#define RenderState_hpp
+
+#include <GLEW/glew.h>
+
+namespace gps {
+
+    enum RenderStateCounter {
+        STATE_PROGRAM,
+        STATE_VERTEX_ARRAY,
+        STATE_ACTIVE_TEXTURE,
+        STATE_TEXTURE,
+        STATE_POLYGON_MODE,
+        STATE_VIEWPORT,
+        STATE_FRAMEBUFFER,
+        STATE_COUNTER_COUNT
+    };
+
+    struct RenderStateStats {
+        unsigned issued[STATE_COUNTER_COUNT];
+        unsigned elided[STATE_COUNTER_COUNT];
+
+        unsigned totalIssued() const;
+        unsigned totalElided() const;
+    };
+
+    // Shadow copy of the GL binding state. Every bind in the renderer goes through it,
+    // so calls that would not change anything are dropped before they reach the driver.
+    // Anything that binds behind its back must call invalidate() afterwards.
+    class RenderState
+    {
+    public:
+        static const GLuint MAX_TEXTURE_UNITS = 32;
+
+        static RenderState& Get();
+
+        void useProgram(GLuint program);
+        void bindVertexArray(GLuint vertexArray);
+        // Binds a GL_TEXTURE_2D on the given unit and leaves that unit active, so texture
+        // edits after the call reach it even when the bind itself was redundant
+        void bindTexture2D(GLuint unit, GLuint texture);
+        void polygonMode(GLenum mode);
+        void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+        void bindFramebuffer(GLuint framebuffer);
+
+        // GL reuses names, so cached bindings of deleted objects must be dropped
+        void onProgramDeleted(GLuint program);
+        void onVertexArrayDeleted(GLuint vertexArray);
+        void onTextureDeleted(GLuint texture);
+        void onFramebufferDeleted(GLuint framebuffer);
+
+        // Forgets everything, the next call of each kind is always issued
+        void invalidate();
+
+        const RenderStateStats& getStats() const;
+        void resetStats();
+        static const char* getCounterName(RenderStateCounter counter);
+
+    private:
+        RenderState();
+
+        bool filter(bool redundant, RenderStateCounter counter);
+
+        GLuint program;
+        GLuint vertexArray;
+        GLuint activeTextureUnit;
+        GLuint textures[MAX_TEXTURE_UNITS];
+        GLenum polygonModeValue;
+        GLint viewportValue[4];
+        GLuint framebuffer;
+
+        RenderStateStats stats;
+    };
+}
+
+#endif /* RenderState_hpp */
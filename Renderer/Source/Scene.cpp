@@ -0,0 +1,259 @@
+#include "Scene.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define GPS_SCENE_SSE 1
+#endif
+
+namespace gps {
+
+    namespace {
+
+        // translation * rotation * scale written out directly instead of three matrix products
+        void composeTransform(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, glm::mat4& result)
+        {
+            float xx = rotation.x * rotation.x, yy = rotation.y * rotation.y, zz = rotation.z * rotation.z;
+            float xy = rotation.x * rotation.y, xz = rotation.x * rotation.z, yz = rotation.y * rotation.z;
+            float wx = rotation.w * rotation.x, wy = rotation.w * rotation.y, wz = rotation.w * rotation.z;
+
+            result[0] = glm::vec4((1.0f - 2.0f * (yy + zz)) * scale.x, 2.0f * (xy + wz) * scale.x, 2.0f * (xz - wy) * scale.x, 0.0f);
+            result[1] = glm::vec4(2.0f * (xy - wz) * scale.y, (1.0f - 2.0f * (xx + zz)) * scale.y, 2.0f * (yz + wx) * scale.y, 0.0f);
+            result[2] = glm::vec4(2.0f * (xz + wy) * scale.z, 2.0f * (yz - wx) * scale.z, (1.0f - 2.0f * (xx + yy)) * scale.z, 0.0f);
+            result[3] = glm::vec4(position, 1.0f);
+        }
+
+        void multiplyMatrices(const glm::mat4& left, const glm::mat4& right, glm::mat4& result)
+        {
+#ifdef GPS_SCENE_SSE
+            // column j of the product is the left columns weighted by right[j]
+            __m128 column0 = _mm_loadu_ps(&left[0][0]);
+            __m128 column1 = _mm_loadu_ps(&left[1][0]);
+            __m128 column2 = _mm_loadu_ps(&left[2][0]);
+            __m128 column3 = _mm_loadu_ps(&left[3][0]);
+            for (int j = 0; j < 4; j++) {
+                __m128 sum = _mm_mul_ps(column0, _mm_set1_ps(right[j][0]));
+                sum = _mm_add_ps(sum, _mm_mul_ps(column1, _mm_set1_ps(right[j][1])));
+                sum = _mm_add_ps(sum, _mm_mul_ps(column2, _mm_set1_ps(right[j][2])));
+                sum = _mm_add_ps(sum, _mm_mul_ps(column3, _mm_set1_ps(right[j][3])));
+                _mm_storeu_ps(&result[j][0], sum);
+            }
+#else
+            result = left * right;
+#endif
+        }
+    }
+
+    Scene::Scene()
+        : anyDirty(false), levelsDirty(false)
+    {
+    }
+
+    uint32_t Scene::createNode(uint32_t parent, const Model3D* model)
+    {
+        uint32_t node = (uint32_t)parents.size();
+        positions.push_back(glm::vec3(0.0f));
+        rotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+        scales.push_back(glm::vec3(1.0f));
+        parents.push_back(parent);
+        models.push_back(model);
+        depths.push_back(parent == NO_PARENT ? 0 : depths[parent] + 1);
+
+        localDirty.push_back(1);
+        worldChanged.push_back(0);
+        worldMatrices.push_back(glm::mat4(1.0f));
+        normalMatrices.push_back(glm::mat3(1.0f));
+        anyDirty = true;
+        levelsDirty = true;
+        return node;
+    }
+
+    void Scene::clear()
+    {
+        positions.clear();
+        rotations.clear();
+        scales.clear();
+        parents.clear();
+        models.clear();
+        depths.clear();
+        localDirty.clear();
+        worldChanged.clear();
+        worldMatrices.clear();
+        normalMatrices.clear();
+        levelOrder.clear();
+        levelStarts.clear();
+        anyDirty = false;
+        levelsDirty = false;
+    }
+
+    size_t Scene::size() const
+    {
+        return parents.size();
+    }
+
+    void Scene::setPosition(uint32_t node, const glm::vec3& position)
+    {
+        positions[node] = position;
+        localDirty[node] = 1;
+        anyDirty = true;
+    }
+
+    void Scene::setRotation(uint32_t node, const glm::quat& rotation)
+    {
+        rotations[node] = rotation;
+        localDirty[node] = 1;
+        anyDirty = true;
+    }
+
+    void Scene::setScale(uint32_t node, const glm::vec3& scale)
+    {
+        scales[node] = scale;
+        localDirty[node] = 1;
+        anyDirty = true;
+    }
+
+    const glm::vec3& Scene::getPosition(uint32_t node) const
+    {
+        return positions[node];
+    }
+
+    const glm::quat& Scene::getRotation(uint32_t node) const
+    {
+        return rotations[node];
+    }
+
+    const glm::vec3& Scene::getScale(uint32_t node) const
+    {
+        return scales[node];
+    }
+
+    uint32_t Scene::getParent(uint32_t node) const
+    {
+        return parents[node];
+    }
+
+    const Model3D* Scene::getModel(uint32_t node) const
+    {
+        return models[node];
+    }
+
+    const glm::mat4& Scene::getWorldMatrix(uint32_t node) const
+    {
+        return worldMatrices[node];
+    }
+
+    const glm::mat3& Scene::getNormalMatrix(uint32_t node) const
+    {
+        return normalMatrices[node];
+    }
+
+    bool Scene::isWorldChanged(uint32_t node) const
+    {
+        return worldChanged[node] != 0;
+    }
+
+    void Scene::rebuildLevels()
+    {
+        // counting sort of the node ids by depth, stable so ids stay ascending per level
+        uint32_t levelCount = 0;
+        for (size_t i = 0; i < depths.size(); i++)
+            levelCount = std::max(levelCount, depths[i] + 1);
+
+        levelStarts.assign(levelCount + 1, 0);
+        for (size_t i = 0; i < depths.size(); i++)
+            levelStarts[depths[i] + 1]++;
+        for (uint32_t level = 0; level < levelCount; level++)
+            levelStarts[level + 1] += levelStarts[level];
+
+        std::vector<size_t> heads(levelStarts.begin(), levelStarts.end() - 1);
+        levelOrder.resize(depths.size());
+        for (size_t i = 0; i < depths.size(); i++)
+            levelOrder[heads[depths[i]]++] = (uint32_t)i;
+        levelsDirty = false;
+    }
+
+    void Scene::updateNodes(const uint32_t* nodes, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            uint32_t node = nodes[i];
+            uint32_t parent = parents[node];
+            bool changed = localDirty[node] || (parent != NO_PARENT && worldChanged[parent]);
+            worldChanged[node] = changed ? 1 : 0;
+            if (!changed)
+                continue;
+
+            localDirty[node] = 0;
+            if (parent == NO_PARENT) {
+                composeTransform(positions[node], rotations[node], scales[node], worldMatrices[node]);
+            }
+            else {
+                glm::mat4 local;
+                composeTransform(positions[node], rotations[node], scales[node], local);
+                multiplyMatrices(worldMatrices[parent], local, worldMatrices[node]);
+            }
+            normalMatrices[node] = ComputeNormalMatrix(worldMatrices[node]);
+        }
+    }
+
+    void Scene::updateWorldMatrices()
+    {
+        if (!anyDirty) {
+            if (!worldChanged.empty())
+                memset(&worldChanged[0], 0, worldChanged.size());
+            return;
+        }
+        if (levelsDirty)
+            rebuildLevels();
+
+        // a level only reads the world matrices and change flags of the level above it
+        for (size_t level = 0; level + 1 < levelStarts.size(); level++) {
+            const uint32_t* nodes = &levelOrder[levelStarts[level]];
+            size_t count = levelStarts[level + 1] - levelStarts[level];
+            if (count < PARALLEL_MIN_NODES * 2) {
+                updateNodes(nodes, count);
+                continue;
+            }
+            parallelFor(count, [this, nodes](size_t begin, size_t end) {
+                updateNodes(nodes + begin, end - begin);
+            });
+        }
+        anyDirty = false;
+    }
+
+    void Scene::parallelFor(size_t count, const std::function<void(size_t, size_t)>& function)
+    {
+        // the workers are started by the first level big enough to split and kept for later frames
+        if (workers.getWorkerCount() == 0)
+            workers.Start();
+
+        size_t chunkCount = std::min(workers.getWorkerCount() + 1, (count + PARALLEL_MIN_NODES - 1) / PARALLEL_MIN_NODES);
+        if (chunkCount <= 1) {
+            function(0, count);
+            return;
+        }
+
+        size_t chunk = (count + chunkCount - 1) / chunkCount;
+        std::mutex mutex;
+        std::condition_variable chunkDone;
+        size_t remaining = 0;
+        for (size_t begin = chunk; begin < count; begin += chunk) {
+            size_t end = std::min(count, begin + chunk);
+            remaining++;
+            workers.submit([&, begin, end]() {
+                function(begin, end);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--remaining == 0)
+                    chunkDone.notify_one();
+            });
+        }
+
+        // the caller takes the first chunk, then waits for the workers' ones
+        function(0, std::min(count, chunk));
+        std::unique_lock<std::mutex> lock(mutex);
+        chunkDone.wait(lock, [&remaining] { return remaining == 0; });
+    }
+}
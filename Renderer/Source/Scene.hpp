@@ -0,0 +1,86 @@
+#ifndef Scene_hpp
+#define Scene_hpp
+
+#include "Model3D.hpp"
+#include "ThreadPool.hpp"
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace gps {
+
+    // Scene nodes stored as parallel arrays indexed by node id. Setting a local transform
+    // marks the node dirty, updateWorldMatrices() then recomposes the dirty nodes and
+    // their descendants in one pass, level by level. Large levels are split over a worker
+    // pool the scene keeps for its lifetime, smaller ones stay on the calling thread.
+    class Scene
+    {
+    public:
+        static const uint32_t NO_PARENT = 0xFFFFFFFF;
+        // below this many nodes in a level the update stays on the calling thread
+        static const size_t PARALLEL_MIN_NODES = 16384;
+
+        Scene();
+        Scene(const Scene&) = delete;
+        Scene& operator=(const Scene&) = delete;
+
+        // The parent must already exist, so parents always precede their children.
+        // A node without a model only carries a transform for its children.
+        uint32_t createNode(uint32_t parent = NO_PARENT, const Model3D* model = NULL);
+        void clear();
+        size_t size() const;
+
+        void setPosition(uint32_t node, const glm::vec3& position);
+        void setRotation(uint32_t node, const glm::quat& rotation);
+        void setScale(uint32_t node, const glm::vec3& scale);
+        const glm::vec3& getPosition(uint32_t node) const;
+        const glm::quat& getRotation(uint32_t node) const;
+        const glm::vec3& getScale(uint32_t node) const;
+
+        uint32_t getParent(uint32_t node) const;
+        const Model3D* getModel(uint32_t node) const;
+
+        void updateWorldMatrices();
+        // World matrices are contiguous by node id, valid after updateWorldMatrices()
+        const glm::mat4& getWorldMatrix(uint32_t node) const;
+        // Normal matrix of the world matrix, recomputed only when it changes
+        const glm::mat3& getNormalMatrix(uint32_t node) const;
+        // Whether the last update changed the node's world matrix
+        bool isWorldChanged(uint32_t node) const;
+
+    private:
+        std::vector<glm::vec3> positions;
+        std::vector<glm::quat> rotations;
+        std::vector<glm::vec3> scales;
+        std::vector<uint32_t> parents;
+        std::vector<const Model3D*> models;
+
+        std::vector<uint8_t> localDirty;
+        std::vector<uint8_t> worldChanged;
+        std::vector<glm::mat4> worldMatrices;
+        std::vector<glm::mat3> normalMatrices;
+        bool anyDirty;
+
+        // node ids grouped by depth, level i spans [levelStarts[i], levelStarts[i + 1])
+        std::vector<uint32_t> depths;
+        std::vector<uint32_t> levelOrder;
+        std::vector<size_t> levelStarts;
+        bool levelsDirty;
+
+        // started on the first level large enough to split
+        ThreadPool workers;
+
+        void rebuildLevels();
+        void updateNodes(const uint32_t* nodes, size_t count);
+        // Splits [0, count) into chunks run on the workers, the caller takes the first chunk
+        // and returns once every chunk is done
+        void parallelFor(size_t count, const std::function<void(size_t, size_t)>& function);
+    };
+}
+
+#endif /* Scene_hpp */
@@ -1,7 +1,143 @@
 #include "Shader.hpp"
+#include "ProgramCache.hpp"
+
+#include <algorithm>
+#include <unordered_map>
 
 namespace gps {
 
+    namespace {
+        std::unordered_map<std::string, UniformId>& uniformRegistry()
+        {
+            static std::unordered_map<std::string, UniformId> registry;
+            return registry;
+        }
+
+        std::unordered_map<std::string, GLuint>& uniformBlockBindings()
+        {
+            static std::unordered_map<std::string, GLuint> bindings;
+            return bindings;
+        }
+    }
+
+    void Shader::setUniformBlockBinding(const std::string& blockName, GLuint binding)
+    {
+        uniformBlockBindings()[blockName] = binding;
+    }
+
+    UniformId Shader::uniformId(const std::string& name)
+    {
+        std::unordered_map<std::string, UniformId>& registry = uniformRegistry();
+        std::unordered_map<std::string, UniformId>::iterator found = registry.find(name);
+        if (found != registry.end())
+            return found->second;
+
+        UniformId id = (UniformId)registry.size();
+        registry[name] = id;
+        return id;
+    }
+
+    Shader::Shader()
+    {
+        this->shaderProgram = 0;
+    }
+
+    Shader::~Shader()
+    {
+        releaseProgram();
+    }
+
+    void Shader::releaseProgram()
+    {
+        if (this->pending.vertexShader) {
+            glDeleteShader(this->pending.vertexShader);
+            glDeleteShader(this->pending.fragmentShader);
+            this->pending = PendingLoad();
+        }
+        if (this->shaderProgram) {
+            RenderState::Get().onProgramDeleted(this->shaderProgram);
+            glDeleteProgram(this->shaderProgram);
+            this->shaderProgram = 0;
+        }
+    }
+
+    Shader::PendingLoad::PendingLoad()
+        : vertexShader(0), fragmentShader(0), cacheable(false), cacheKey(0)
+    {
+    }
+
+    Shader::Shader(Shader&& other) noexcept
+    {
+        this->shaderProgram = other.shaderProgram;
+        this->uniformLocations.swap(other.uniformLocations);
+        this->pending = std::move(other.pending);
+        other.shaderProgram = 0;
+        other.pending = PendingLoad();
+    }
+
+    Shader& Shader::operator=(Shader&& other) noexcept
+    {
+        if (this != &other) {
+            releaseProgram();
+            this->shaderProgram = other.shaderProgram;
+            this->uniformLocations.swap(other.uniformLocations);
+            this->pending = std::move(other.pending);
+            other.shaderProgram = 0;
+            other.uniformLocations.clear();
+            other.pending = PendingLoad();
+        }
+        return *this;
+    }
+
+    void Shader::reflectUniforms()
+    {
+        std::vector<GLint> locations;
+
+        GLint uniformCount = 0;
+        GLint maxNameLength = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORMS, &uniformCount);
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+        std::vector<GLchar> nameBuffer(std::max(maxNameLength, 1));
+
+        for (GLint i = 0; i < uniformCount; i++) {
+            GLsizei nameLength = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(this->shaderProgram, (GLuint)i, (GLsizei)nameBuffer.size(), &nameLength, &size, &type, &nameBuffer[0]);
+            std::string name(&nameBuffer[0], nameLength);
+
+            // uniforms inside blocks have no location
+            GLint location = glGetUniformLocation(this->shaderProgram, name.c_str());
+            if (location < 0)
+                continue;
+
+            UniformId id = uniformId(name);
+            if (id >= locations.size())
+                locations.resize(id + 1, -1);
+            locations[id] = location;
+
+            // arrays are reported as "name[0]", register them under the plain name as well
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+                UniformId plainId = uniformId(name.substr(0, name.size() - 3));
+                if (plainId >= locations.size())
+                    locations.resize(plainId + 1, -1);
+                locations[plainId] = location;
+            }
+        }
+
+        this->uniformLocations.swap(locations);
+    }
+
+    void Shader::bindUniformBlocks()
+    {
+        const std::unordered_map<std::string, GLuint>& bindings = uniformBlockBindings();
+        for (std::unordered_map<std::string, GLuint>::const_iterator it = bindings.begin(); it != bindings.end(); ++it) {
+            GLuint blockIndex = glGetUniformBlockIndex(this->shaderProgram, it->first.c_str());
+            if (blockIndex != GL_INVALID_INDEX)
+                glUniformBlockBinding(this->shaderProgram, blockIndex, it->second);
+        }
+    }
+
 
 
     std::string Shader::readShaderFile(std::string fileName)
@@ -25,6 +161,60 @@ namespace gps {
         return shaderString;
     }
 
+    void Shader::expandShaderFile(const std::string& fileName, std::vector<std::string>& included, std::string& source)
+    {
+        included.push_back(fileName);
+        std::string text = readShaderFile(fileName);
+        if (text.empty())
+            std::cerr << "ERROR: could not read " << fileName << std::endl;
+        std::string directory = fileName.substr(0, fileName.find_last_of('/') + 1);
+
+        size_t lineStart = 0;
+        while (lineStart < text.size()) {
+            size_t lineEnd = text.find('\n', lineStart);
+            if (lineEnd == std::string::npos)
+                lineEnd = text.size();
+            else
+                lineEnd++;
+
+            // #include "name", resolved next to the including file
+            size_t directive = text.find_first_not_of(" \t", lineStart);
+            size_t open = std::string::npos, close = std::string::npos;
+            if (directive < lineEnd && text.compare(directive, 8, "#include") == 0) {
+                open = text.find('"', directive + 8);
+                close = open < lineEnd ? text.find('"', open + 1) : std::string::npos;
+            }
+            if (close < lineEnd) {
+                std::string includeName = directory + text.substr(open + 1, close - open - 1);
+                // every file is pasted once per source, which also stops include cycles
+                if (std::find(included.begin(), included.end(), includeName) == included.end())
+                    expandShaderFile(includeName, included, source);
+            } else {
+                source.append(text, lineStart, lineEnd - lineStart);
+            }
+            lineStart = lineEnd;
+        }
+        if (!source.empty() && source[source.size() - 1] != '\n')
+            source += '\n';
+    }
+
+    std::string Shader::preprocessShaderFile(const std::string& fileName, const std::string& defines)
+    {
+        std::vector<std::string> included;
+        std::string source;
+        expandShaderFile(fileName, included, source);
+
+        // GLSL wants #version before anything else, the defines go right behind it
+        size_t insertAt = 0;
+        size_t version = source.find("#version");
+        if (version != std::string::npos) {
+            size_t lineEnd = source.find('\n', version);
+            insertAt = lineEnd == std::string::npos ? source.size() : lineEnd + 1;
+        }
+        source.insert(insertAt, defines);
+        return source;
+    }
+
     void Shader::shaderCompileLog(GLuint shaderId)
     {
         GLint success;
@@ -39,7 +229,7 @@ namespace gps {
         }
     }
 
-    void Shader::shaderLinkLog(GLuint shaderProgramId)
+    bool Shader::shaderLinkLog(GLuint shaderProgramId)
     {
         GLint success;
         GLchar infoLog[512];
@@ -50,47 +240,88 @@ namespace gps {
             glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
             std::cout << "Shader linking error\n" << infoLog << std::endl;
         }
+        return success == GL_TRUE;
+    }
+
+    void Shader::EnableParallelCompile()
+    {
+        // the driver picks the thread count, compiles and links then return before they finish
+        if (GLEW_KHR_parallel_shader_compile)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    }
+
+    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::string defines)
+    {
+        beginLoad(vertexShaderFileName, fragmentShaderFileName, defines);
+        finishLoad();
     }
 
-    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName)
+    void Shader::beginLoad(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName, const std::string& defines)
     {
-       
-        //read, parse and compile the vertex shader
-        std::string v = readShaderFile(vertexShaderFileName);
+        std::string v = preprocessShaderFile(vertexShaderFileName, defines);
+        std::string f = preprocessShaderFile(fragmentShaderFileName, defines);
+
+        //release the program of a previous load (shader hot-reload)
+        releaseProgram();
+
+        // a binary linked by the same driver from the same sources skips compiling
+        this->pending.cacheable = ProgramCache::IsSupported();
+        if (this->pending.cacheable) {
+            this->pending.cacheKey = ProgramCache::ComputeKey(v, f, defines);
+            this->pending.cachePath = ProgramCache::GetCachePath(vertexShaderFileName, fragmentShaderFileName, defines);
+            this->shaderProgram = ProgramCache::Read(this->pending.cachePath, this->pending.cacheKey);
+            if (this->shaderProgram) {
+                this->pending.cacheable = false;
+                return;
+            }
+        }
+
+        //compile the vertex shader
         const GLchar* vertexShaderString = v.c_str();
-        GLuint vertexShader;
-        vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
-        glCompileShader(vertexShader);
-        //check compilation status
-        shaderCompileLog(vertexShader);
-
-        //read, parse and compile the vertex shader
-        std::string f = readShaderFile(fragmentShaderFileName);
+        this->pending.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(this->pending.vertexShader, 1, &vertexShaderString, NULL);
+        glCompileShader(this->pending.vertexShader);
+
+        //compile the fragment shader
         const GLchar* fragmentShaderString = f.c_str();
-        GLuint fragmentShader;
-        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
-        glCompileShader(fragmentShader);
-        //check compilation status
-        shaderCompileLog(fragmentShader);
-
-        //attach and link the shader programs
+        this->pending.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(this->pending.fragmentShader, 1, &fragmentShaderString, NULL);
+        glCompileShader(this->pending.fragmentShader);
+
+        //attach and link the shader programs, the status is only read in finishLoad()
         this->shaderProgram = glCreateProgram();
-        glAttachShader(this->shaderProgram, vertexShader);
-        glAttachShader(this->shaderProgram, fragmentShader);
+        if (this->pending.cacheable)
+            glProgramParameteri(this->shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glAttachShader(this->shaderProgram, this->pending.vertexShader);
+        glAttachShader(this->shaderProgram, this->pending.fragmentShader);
         glLinkProgram(this->shaderProgram);
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
-        //check linking info
-        shaderLinkLog(this->shaderProgram);
+    }
 
-       
+    void Shader::finishLoad()
+    {
+        if (this->pending.vertexShader) {
+            //check compilation status
+            shaderCompileLog(this->pending.vertexShader);
+            shaderCompileLog(this->pending.fragmentShader);
+            glDeleteShader(this->pending.vertexShader);
+            glDeleteShader(this->pending.fragmentShader);
+
+            //check linking info
+            bool linked = shaderLinkLog(this->shaderProgram);
+            if (linked && this->pending.cacheable && !ProgramCache::Write(this->pending.cachePath, this->pending.cacheKey, this->shaderProgram))
+                std::cerr << "WARNING: could not write " << this->pending.cachePath << std::endl;
+        }
+        this->pending = PendingLoad();
+
+        if (this->shaderProgram) {
+            reflectUniforms();
+            bindUniformBlocks();
+        }
     }
 
-    void Shader::useShaderProgram()
+    void Shader::useShaderProgram() const
     {
-        glUseProgram(this->shaderProgram);
+        RenderState::Get().useProgram(this->shaderProgram);
     }
   
    
@@ -3,45 +3,144 @@
 
 #include <GLEW/glew.h>
 
+#include "RenderState.hpp"
+
+#include <cstdint>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <vector>
 #include <glm/glm.hpp> 
 namespace gps {
 
+// Process wide id of a uniform name, the same name maps to the same id in every program
+typedef unsigned UniformId;
+
+// Owns its GL program object, so it can be moved but not copied
 class Shader
 {
 public:
     GLuint shaderProgram;
-    void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
-    void useShaderProgram();
 
+    Shader();
+    ~Shader();
+    Shader(Shader&& other) noexcept;
+    Shader& operator=(Shader&& other) noexcept;
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+
+    // Compiles and links the program, replacing (and deleting) any previously loaded one.
+    // Restores it from the ProgramCache instead when the sources and driver match.
+    // Both sources are preprocessed: `#include "file"` lines are replaced by the file, looked up
+    // next to the including one and pasted once, and defines (GLSL lines such as "#define FOG\n")
+    // are inserted after #version.
+    void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::string defines = "");
+    // loadShader() in two halves: begin compiles and links without waiting for the driver,
+    // finish reads the results. Beginning several programs before finishing any lets the
+    // driver build them side by side.
+    void beginLoad(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName, const std::string& defines = "");
+    void finishLoad();
+    void useShaderProgram() const;
+
+    // Interns a uniform name, resolve ids once (e.g. into a static) and use them on the hot path
+    static UniformId uniformId(const std::string& name);
+
+    // Every program linked afterwards that declares the named uniform block gets it at this binding point
+    static void setUniformBlockBinding(const std::string& blockName, GLuint binding);
+
+    // Lets the driver compile and link on its own threads (KHR_parallel_shader_compile), call once after context creation
+    static void EnableParallelCompile();
+
+    // Location reflected at link time, -1 if the program has no such active uniform
+    GLint getUniformLocation(UniformId id) const
+    {
+        return id < uniformLocations.size() ? uniformLocations[id] : -1;
+    }
+    GLint getUniformLocation(const std::string& name) const
+    {
+        return getUniformLocation(uniformId(name));
+    }
 
     // Functions To set Data onto Shaders
+    void setMat4(UniformId id, const glm::mat4& mat) const
+    {
+        glUniformMatrix4fv(getUniformLocation(id), 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat3(UniformId id, const glm::mat3& mat) const
+    {
+        glUniformMatrix3fv(getUniformLocation(id), 1, GL_FALSE, &mat[0][0]);
+    }
+    void setInt(UniformId id, int value) const
+    {
+        glUniform1i(getUniformLocation(id), value);
+    }
+    void setFloat(UniformId id, float value) const
+    {
+        glUniform1f(getUniformLocation(id), value);
+    }
+    void setVec3(UniformId id, float x, float y, float z) const
+    {
+        glUniform3f(getUniformLocation(id), x, y, z);
+    }
+    void setVec3(UniformId id, const glm::vec3& value) const
+    {
+        glUniform3fv(getUniformLocation(id), 1, &value[0]);
+    }
+
     void setMat4(const std::string& name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(uniformId(name), mat);
+    }
+    void setMat3(const std::string& name, const glm::mat3& mat) const
+    {
+        setMat3(uniformId(name), mat);
     }
     void setInt(const std::string& name, int value) const
     {
-        glUniform1i(glGetUniformLocation(shaderProgram, name.c_str()), value);
+        setInt(uniformId(name), value);
     }
     void setFloat(const std::string& name, float value) const
     {
-        glUniform1f(glGetUniformLocation(shaderProgram, name.c_str()), value);
+        setFloat(uniformId(name), value);
     }
     void setVec3(const std::string& name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(shaderProgram, name.c_str()), x, y, z);
+        setVec3(uniformId(name), x, y, z);
+    }
+    void setVec3(const std::string& name, const glm::vec3& value) const
+    {
+        setVec3(uniformId(name), value);
     }
 private:
+    // between beginLoad() and finishLoad()
+    struct PendingLoad {
+        GLuint vertexShader;
+        GLuint fragmentShader;
+        bool cacheable;
+        uint64_t cacheKey;
+        std::string cachePath;
+
+        PendingLoad();
+    };
+
+    // location per UniformId
+    std::vector<GLint> uniformLocations;
+    PendingLoad pending;
 
-   
     std::string readShaderFile(std::string fileName);
+    // Appends the file to source with its includes expanded, skipping files already in included
+    void expandShaderFile(const std::string& fileName, std::vector<std::string>& included, std::string& source);
+    std::string preprocessShaderFile(const std::string& fileName, const std::string& defines);
     void shaderCompileLog(GLuint shaderId);
-    void shaderLinkLog(GLuint shaderProgramId);
+    // False if the program did not link
+    bool shaderLinkLog(GLuint shaderProgramId);
+    void releaseProgram();
+    // Builds the uniform location table of the linked program
+    void reflectUniforms();
+    // Assigns the registered binding points to the program's uniform blocks
+    void bindUniformBlocks();
 };
 
 }
@@ -0,0 +1,76 @@
+#include "ShaderVariants.hpp"
+
+namespace gps {
+
+    namespace {
+        struct FeatureDefine {
+            ShaderFeature feature;
+            const char* name;
+        };
+
+        const FeatureDefine FEATURE_DEFINES[] = {
+            { SHADER_SHADOWS, "SHADOWS" },
+            { SHADER_FOG, "FOG" },
+            { SHADER_POINT_LIGHT, "POINT_LIGHT" },
+            { SHADER_INSTANCED, "INSTANCED" },
+            { SHADER_QUANTIZED_VERTS, "QUANTIZED_VERTS" }
+        };
+    }
+
+    std::string ShaderVariants::Defines(ShaderFeatures features)
+    {
+        std::string defines;
+        for (size_t i = 0; i < sizeof(FEATURE_DEFINES) / sizeof(FEATURE_DEFINES[0]); i++) {
+            if (features & FEATURE_DEFINES[i].feature)
+                defines += std::string("#define ") + FEATURE_DEFINES[i].name + "\n";
+        }
+        return defines;
+    }
+
+    ShaderVariants::ShaderVariants()
+    {
+    }
+
+    void ShaderVariants::setSources(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName)
+    {
+        Release();
+        this->vertexShaderFileName = vertexShaderFileName;
+        this->fragmentShaderFileName = fragmentShaderFileName;
+    }
+
+    void ShaderVariants::prepare(const std::vector<ShaderFeatures>& featureMasks)
+    {
+        std::vector<Shader*> started;
+        for (size_t i = 0; i < featureMasks.size(); i++) {
+            if (variants.count(featureMasks[i]))
+                continue;
+            Shader& variant = variants[featureMasks[i]];
+            variant.beginLoad(vertexShaderFileName, fragmentShaderFileName, Defines(featureMasks[i]));
+            started.push_back(&variant);
+        }
+        // map nodes do not move, so the pointers survive the inserts above
+        for (size_t i = 0; i < started.size(); i++)
+            started[i]->finishLoad();
+    }
+
+    const Shader& ShaderVariants::get(ShaderFeatures features)
+    {
+        std::unordered_map<ShaderFeatures, Shader>::iterator found = variants.find(features);
+        if (found != variants.end())
+            return found->second;
+
+        Shader& variant = variants[features];
+        variant.loadShader(vertexShaderFileName, fragmentShaderFileName, Defines(features));
+        return variant;
+    }
+
+    size_t ShaderVariants::size() const
+    {
+        return variants.size();
+    }
+
+    void ShaderVariants::Release()
+    {
+        variants.clear();
+    }
+}
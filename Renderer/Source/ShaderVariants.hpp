@@ -0,0 +1,59 @@
+#ifndef ShaderVariants_hpp
+#define ShaderVariants_hpp
+
+#include "Shader.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gps {
+
+    // Optional parts of an uber-shader, each compiled in by the define of the same name
+    enum ShaderFeature {
+        // shadow map lookup, needs the shadowMap sampler
+        SHADER_SHADOWS = 1 << 0,
+        // distance fog
+        SHADER_FOG = 1 << 1,
+        // light from LightBlock's lightPos instead of along lightDir
+        SHADER_POINT_LIGHT = 1 << 2,
+        // per-instance transforms behind the instancedTransforms uniform
+        SHADER_INSTANCED = 1 << 3,
+        // quantized vertex decoding behind the quantizedVertices uniform,
+        // without it the program only draws full float vertices
+        SHADER_QUANTIZED_VERTS = 1 << 4
+    };
+    // Bitmask of ShaderFeature
+    typedef unsigned ShaderFeatures;
+
+    // Permutations of one vertex and fragment uber-source, built on first use or ahead of
+    // time with prepare() and kept by feature mask. Every permutation is a program of its
+    // own, so a draw only pays for the features it asked for.
+    class ShaderVariants
+    {
+    public:
+        ShaderVariants();
+        ShaderVariants(const ShaderVariants&) = delete;
+        ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+        // The GLSL defines of a feature mask, e.g. "#define FOG\n"
+        static std::string Defines(ShaderFeatures features);
+
+        // Drops the permutations built from earlier sources
+        void setSources(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName);
+        // Builds the permutations not built yet, beginning every one before finishing any
+        void prepare(const std::vector<ShaderFeatures>& featureMasks);
+        // The permutation with exactly these features, compiled now if it is the first request.
+        // The reference stays valid until Release() or setSources().
+        const Shader& get(ShaderFeatures features);
+        size_t size() const;
+        void Release();
+
+    private:
+        std::string vertexShaderFileName;
+        std::string fragmentShaderFileName;
+        std::unordered_map<ShaderFeatures, Shader> variants;
+    };
+}
+
+#endif /* ShaderVariants_hpp */
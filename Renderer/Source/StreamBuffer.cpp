@@ -0,0 +1,150 @@
+#include "StreamBuffer.hpp"
+
+#include <cstring>
+#include <iostream>
+
+namespace gps {
+
+    bool StreamBuffer::IsSupported()
+    {
+        return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+    }
+
+    StreamBuffer::StreamBuffer()
+        : buffer(0), mapped(NULL), frameSize(0), frame(0), head(0), stallCount(0), overflowReported(false)
+    {
+        for (int i = 0; i < FRAME_COUNT; i++)
+            fences[i] = 0;
+    }
+
+    StreamBuffer::~StreamBuffer()
+    {
+        Release();
+    }
+
+    bool StreamBuffer::Create(GLsizeiptr frameSize)
+    {
+        Release();
+
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &this->buffer);
+        // bound to a target no other code relies on
+        glBindBuffer(GL_COPY_WRITE_BUFFER, this->buffer);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, frameSize * FRAME_COUNT, NULL, flags);
+        this->mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameSize * FRAME_COUNT, flags);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        if (!this->mapped) {
+            std::cerr << "ERROR: could not map the stream buffer" << std::endl;
+            Release();
+            return false;
+        }
+
+        this->frameSize = frameSize;
+        this->frame = 0;
+        this->head = 0;
+        this->stallCount = 0;
+        this->overflowReported = false;
+        return true;
+    }
+
+    void StreamBuffer::Release()
+    {
+        // an uncreated buffer may outlive the GL context
+        if (!this->buffer)
+            return;
+
+        for (int i = 0; i < FRAME_COUNT; i++) {
+            if (this->fences[i])
+                glDeleteSync(this->fences[i]);
+            this->fences[i] = 0;
+        }
+        if (this->mapped) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, this->buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &this->buffer);
+        this->buffer = 0;
+        this->mapped = NULL;
+        this->frameSize = 0;
+    }
+
+    bool StreamBuffer::isCreated() const
+    {
+        return this->mapped != NULL;
+    }
+
+    GLuint StreamBuffer::getBuffer() const
+    {
+        return this->buffer;
+    }
+
+    void StreamBuffer::beginFrame()
+    {
+        if (!this->mapped)
+            return;
+
+        this->frame = (this->frame + 1) % FRAME_COUNT;
+        this->head = this->frame * this->frameSize;
+
+        GLsync fence = this->fences[this->frame];
+        if (!fence)
+            return;
+
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED) {
+            this->stallCount++;
+            // one second per try, flushing so the fence is guaranteed to signal
+            do {
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            } while (result == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fence);
+        this->fences[this->frame] = 0;
+    }
+
+    void StreamBuffer::endFrame()
+    {
+        if (!this->mapped)
+            return;
+
+        if (this->fences[this->frame])
+            glDeleteSync(this->fences[this->frame]);
+        this->fences[this->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    void* StreamBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset)
+    {
+        if (!this->mapped)
+            return NULL;
+
+        GLintptr aligned = (this->head + alignment - 1) / alignment * alignment;
+        if (aligned + size > (this->frame + 1) * this->frameSize) {
+            if (!this->overflowReported) {
+                std::cerr << "WARNING: stream buffer region of " << this->frameSize << " bytes is full" << std::endl;
+                this->overflowReported = true;
+            }
+            return NULL;
+        }
+
+        this->head = aligned + size;
+        offset = aligned;
+        return this->mapped + aligned;
+    }
+
+    GLintptr StreamBuffer::write(const void* data, GLsizeiptr size, GLsizeiptr alignment)
+    {
+        GLintptr offset;
+        void* destination = allocate(size, alignment, offset);
+        if (!destination)
+            return -1;
+        memcpy(destination, data, size);
+        return offset;
+    }
+
+    unsigned StreamBuffer::getStallCount() const
+    {
+        return this->stallCount;
+    }
+}
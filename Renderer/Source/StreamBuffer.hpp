@@ -0,0 +1,56 @@
+#ifndef StreamBuffer_hpp
+#define StreamBuffer_hpp
+
+#include <GLEW/glew.h>
+
+namespace gps {
+
+    // Persistently mapped buffer split into FRAME_COUNT regions used round-robin.
+    // Per-frame data is copied linearly into the current region and bound by offset;
+    // a fence per region makes beginFrame() wait only if the GPU still reads the
+    // region being reused. Needs GL 4.4 or ARB_buffer_storage, see IsSupported().
+    class StreamBuffer
+    {
+    public:
+        static const int FRAME_COUNT = 3;
+
+        static bool IsSupported();
+
+        StreamBuffer();
+        ~StreamBuffer();
+        StreamBuffer(const StreamBuffer&) = delete;
+        StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+        bool Create(GLsizeiptr frameSize);
+        void Release();
+        bool isCreated() const;
+
+        GLuint getBuffer() const;
+
+        // Moves to the next region, waiting for its fence if needed
+        void beginFrame();
+        // Fences everything submitted this frame
+        void endFrame();
+
+        // Reserves size bytes of the current region at a multiple of alignment (any positive value).
+        // Returns the mapped pointer and sets offset, or NULL when the region is full.
+        void* allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset);
+        // Copies data into a new allocation, returns its offset or -1 when the region is full
+        GLintptr write(const void* data, GLsizeiptr size, GLsizeiptr alignment);
+
+        // Number of beginFrame() calls that had to wait for the GPU
+        unsigned getStallCount() const;
+
+    private:
+        GLuint buffer;
+        unsigned char* mapped;
+        GLsizeiptr frameSize;
+        int frame;
+        GLintptr head;
+        GLsync fences[FRAME_COUNT];
+        unsigned stallCount;
+        bool overflowReported;
+    };
+}
+
+#endif /* StreamBuffer_hpp */
@@ -0,0 +1,177 @@
+#include "TextureCache.hpp"
+#include "BlockCompression.hpp"
+#include "MappedFile.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace gps {
+
+    namespace {
+
+        const char CACHE_MAGIC[4] = { 'G', 'P', 'S', 'T' };
+        const uint64_t BLOB_ALIGNMENT = 16;
+        // 32k x 32k at most
+        const uint32_t MAX_LEVELS = 16;
+
+        struct FileHeader {
+            char magic[4];
+            uint32_t version;
+            uint32_t compression;
+            uint32_t channels;
+            uint32_t levelCount;
+            uint32_t padding;
+            uint64_t sourceSize;
+            int64_t sourceModificationTime;
+            uint64_t fileSize;
+        };
+
+        struct LevelRecord {
+            uint32_t width;
+            uint32_t height;
+            uint64_t offset;
+            uint64_t size;
+        };
+
+        uint64_t alignOffset(uint64_t offset)
+        {
+            return (offset + BLOB_ALIGNMENT - 1) & ~(BLOB_ALIGNMENT - 1);
+        }
+    }
+
+    std::string TextureCache::GetCachePath(const std::string& sourceFileName)
+    {
+        return sourceFileName + ".texcache";
+    }
+
+    bool TextureCache::Read(const std::string& sourceFileName, Image& image)
+    {
+        uint64_t sourceSize;
+        int64_t sourceModificationTime;
+        if (!MappedFile::Stat(sourceFileName, sourceSize, sourceModificationTime))
+            return false;
+
+        MappedFile file;
+        if (!file.Open(GetCachePath(sourceFileName)))
+            return false;
+
+        const unsigned char* data = file.getData();
+        uint64_t size = file.getSize();
+        if (size < sizeof(FileHeader))
+            return false;
+
+        FileHeader header;
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+            header.version != VERSION ||
+            header.sourceSize != sourceSize ||
+            header.sourceModificationTime != sourceModificationTime ||
+            header.fileSize != size ||
+            header.compression == IMAGE_UNCOMPRESSED || header.compression > IMAGE_BC5 ||
+            header.levelCount == 0 || header.levelCount > MAX_LEVELS) {
+            return false;
+        }
+
+        uint64_t recordsEnd = sizeof(FileHeader) + (uint64_t)header.levelCount * sizeof(LevelRecord);
+        if (recordsEnd > size)
+            return false;
+
+        ImageCompression compression = (ImageCompression)header.compression;
+        std::vector<LevelRecord> records(header.levelCount);
+        memcpy(records.data(), data + sizeof(FileHeader), records.size() * sizeof(LevelRecord));
+        std::vector<Image::Level> levels(header.levelCount);
+        uint64_t total = 0;
+        for (uint32_t l = 0; l < header.levelCount; l++) {
+            const LevelRecord& record = records[l];
+            if (record.width == 0 || record.height == 0 || record.offset + record.size > size ||
+                record.size != Image::LevelSize(record.width, record.height, header.channels, compression)) {
+                return false;
+            }
+            levels[l].width = (int)record.width;
+            levels[l].height = (int)record.height;
+            levels[l].offset = (size_t)total;
+            levels[l].size = (size_t)record.size;
+            total += record.size;
+        }
+
+        // the blocks go to the GPU as they are, one copy out of the mapping per level
+        unsigned char* blocks = image.Allocate(levels, (int)header.channels, compression);
+        if (!blocks)
+            return false;
+        for (uint32_t l = 0; l < header.levelCount; l++)
+            memcpy(blocks + levels[l].offset, data + records[l].offset, levels[l].size);
+        return true;
+    }
+
+    bool TextureCache::Write(const std::string& sourceFileName, const Image& image)
+    {
+        if (!image.isLoaded() || image.getCompression() == IMAGE_UNCOMPRESSED || image.getLevelCount() > MAX_LEVELS)
+            return false;
+
+        FileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.version = VERSION;
+        header.compression = (uint32_t)image.getCompression();
+        header.channels = (uint32_t)image.getChannels();
+        header.levelCount = (uint32_t)image.getLevelCount();
+        if (!MappedFile::Stat(sourceFileName, header.sourceSize, header.sourceModificationTime))
+            return false;
+
+        std::vector<LevelRecord> records(image.getLevelCount());
+        uint64_t offset = sizeof(FileHeader) + records.size() * sizeof(LevelRecord);
+        for (size_t l = 0; l < records.size(); l++) {
+            const Image::Level& level = image.getLevel(l);
+            offset = alignOffset(offset);
+            records[l].width = (uint32_t)level.width;
+            records[l].height = (uint32_t)level.height;
+            records[l].offset = offset;
+            records[l].size = level.size;
+            offset += level.size;
+        }
+        header.fileSize = offset;
+
+        // write to a temporary file first so a crash never leaves a half written cache behind
+        std::string cachePath = GetCachePath(sourceFileName);
+        std::string tempPath = cachePath + ".tmp";
+        std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+
+        static const char zeros[BLOB_ALIGNMENT] = { 0 };
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)records.data(), (std::streamsize)(records.size() * sizeof(LevelRecord)));
+        uint64_t written = sizeof(FileHeader) + records.size() * sizeof(LevelRecord);
+        for (size_t l = 0; l < records.size(); l++) {
+            out.write(zeros, (std::streamsize)(records[l].offset - written));
+            out.write((const char*)image.getLevelPixels(l), (std::streamsize)records[l].size);
+            written = records[l].offset + records[l].size;
+        }
+        out.close();
+
+        if (!out) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+
+        std::remove(cachePath.c_str());
+        if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    bool TextureCache::Cook(const std::string& sourceFileName, Image& cooked)
+    {
+        Image source;
+        if (!source.Load(sourceFileName, 0, true))
+            return false;
+
+        source.GenerateMipmaps();
+        return CompressImage(source, ChooseCompression(source), cooked) && Write(sourceFileName, cooked);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef TextureCache_hpp
+#define TextureCache_hpp
+
+#include "Image.hpp"
+
+#include <cstdint>
+#include <string>
+
+namespace gps {
+
+    // Cooked texture written next to a source image as "<image>.texcache".
+    // Layout: header, one record per mip level, then the level blobs, block compressed
+    // with rows bottom first as GL expects, so nothing is decoded or flipped at load.
+    // The cache is rejected when the version or the source file's size or
+    // modification time no longer match.
+    class TextureCache
+    {
+    public:
+        static const uint32_t VERSION = 1;
+
+        static std::string GetCachePath(const std::string& sourceFileName);
+
+        // Maps the cache for sourceFileName and fills image, false if missing or stale
+        static bool Read(const std::string& sourceFileName, Image& image);
+
+        // Writes the cache for sourceFileName, false if it could not be written
+        static bool Write(const std::string& sourceFileName, const Image& image);
+
+        // Decodes the source, builds its mip chain and compresses it with
+        // ChooseCompression() into the cache. Needs no GL context.
+        static bool Cook(const std::string& sourceFileName, Image& cooked);
+    };
+}
+
+#endif /* TextureCache_hpp */
@@ -0,0 +1,314 @@
+#include "TextureUploader.hpp"
+
+#include "RenderState.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace gps {
+
+    bool TextureUploader::HasImmutableStorage()
+    {
+        return GLEW_VERSION_4_2 || GLEW_ARB_texture_storage;
+    }
+
+    GLenum TextureUploader::PixelFormat(int channels)
+    {
+        if (channels == 1)
+            return GL_RED;
+        if (channels == 2)
+            return GL_RG;
+        if (channels == 3)
+            return GL_RGB;
+        return GL_RGBA;
+    }
+
+    GLenum TextureUploader::ColorFormat(int channels, bool srgb)
+    {
+        if (channels == 1)
+            return GL_R8;
+        if (channels == 2)
+            return GL_RG8;
+        if (channels == 3)
+            return srgb ? GL_SRGB8 : GL_RGB8;
+        return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    }
+
+    void TextureUploader::SetGreySwizzle(int channels)
+    {
+        if (channels > 2)
+            return;
+        const GLint swizzle[2][4] = {
+            { GL_RED, GL_RED, GL_RED, GL_ONE },
+            { GL_RED, GL_RED, GL_RED, GL_GREEN }
+        };
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle[channels - 1]);
+    }
+
+    bool TextureUploader::SupportsCompression(ImageCompression compression)
+    {
+        switch (compression) {
+        case IMAGE_UNCOMPRESSED:
+            return true;
+        case IMAGE_BC1:
+        case IMAGE_BC3:
+            return GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+        default:
+            return GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc;
+        }
+    }
+
+    GLenum TextureUploader::CompressedFormat(ImageCompression compression, bool srgb)
+    {
+        switch (compression) {
+        case IMAGE_BC1:
+            return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case IMAGE_BC3:
+            return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case IMAGE_BC4:
+            return GL_COMPRESSED_RED_RGTC1;
+        case IMAGE_BC5:
+            return GL_COMPRESSED_RG_RGTC2;
+        default:
+            return GL_NONE;
+        }
+    }
+
+    TextureUploader::TextureUploader()
+        : buffer(0), frameBudget(0), uploadedBytes(0)
+    {
+    }
+
+    TextureUploader::~TextureUploader()
+    {
+        Release();
+    }
+
+    bool TextureUploader::Create(GLsizeiptr frameBudget)
+    {
+        Release();
+
+        if (!StreamBuffer::IsSupported() || !staging.Create(frameBudget))
+            glGenBuffers(1, &this->buffer);
+
+        this->frameBudget = frameBudget;
+        this->uploadedBytes = 0;
+        return true;
+    }
+
+    void TextureUploader::Release()
+    {
+        this->queue.clear();
+        staging.Release();
+        // an uncreated uploader may outlive the GL context
+        if (this->buffer) {
+            glDeleteBuffers(1, &this->buffer);
+            this->buffer = 0;
+        }
+        this->frameBudget = 0;
+    }
+
+    bool TextureUploader::isCreated() const
+    {
+        return this->frameBudget != 0;
+    }
+
+    GLuint TextureUploader::enqueue(Image&& image, const TextureDesc& desc, const std::function<void(GLuint)>& onComplete)
+    {
+        ImageCompression compression = image.getCompression();
+        bool compressed = compression != IMAGE_UNCOMPRESSED;
+        GLenum internalFormat = desc.internalFormat;
+        GLenum format = PixelFormat(image.getChannels());
+        // the GL cannot build mipmaps of block formats, compressed textures keep their own levels
+        int levelCount = Image::MipLevelCount(image.getWidth(), image.getHeight());
+        if (compressed) {
+            bool srgb = internalFormat == GL_SRGB8 || internalFormat == GL_SRGB8_ALPHA8 ||
+                internalFormat == GL_SRGB || internalFormat == GL_SRGB_ALPHA;
+            internalFormat = CompressedFormat(compression, srgb);
+            format = internalFormat;
+            levelCount = (int)image.getLevelCount();
+        }
+
+        GLuint texture;
+        glGenTextures(1, &texture);
+        RenderState::Get().bindTexture2D(0, texture);
+        if (HasImmutableStorage()) {
+            glTexStorage2D(GL_TEXTURE_2D, levelCount, internalFormat, image.getWidth(), image.getHeight());
+        } else {
+            for (int i = 0; i < levelCount; i++) {
+                GLsizei width = image.getWidth() >> i > 0 ? image.getWidth() >> i : 1;
+                GLsizei height = image.getHeight() >> i > 0 ? image.getHeight() >> i : 1;
+                if (compressed) {
+                    GLsizei size = (GLsizei)Image::LevelSize(width, height, image.getChannels(), compression);
+                    glCompressedTexImage2D(GL_TEXTURE_2D, i, internalFormat, width, height, 0, size, NULL);
+                } else {
+                    glTexImage2D(GL_TEXTURE_2D, i, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, NULL);
+                }
+            }
+        }
+
+        // sampling stays within the levels already uploaded
+        int lastLevel = (int)image.getLevelCount() - 1;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, lastLevel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, desc.wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, desc.wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        SetGreySwizzle(image.getChannels());
+        RenderState::Get().bindTexture2D(0, 0);
+
+        Upload upload;
+        upload.texture = texture;
+        upload.format = format;
+        upload.level = lastLevel;
+        upload.row = 0;
+        upload.generateMipmaps = (int)image.getLevelCount() < levelCount;
+        upload.onComplete = onComplete;
+        upload.image = std::move(image);
+        this->queue.push_back(std::move(upload));
+        return texture;
+    }
+
+    void TextureUploader::update()
+    {
+        if (this->queue.empty() || !isCreated())
+            return;
+
+        unsigned char* mapped = NULL;
+        GLuint unpackBuffer = this->buffer;
+        if (staging.isCreated()) {
+            staging.beginFrame();
+            unpackBuffer = staging.getBuffer();
+        } else {
+            // orphaning hands the driver fresh storage instead of waiting for last frame's copies
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->buffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, this->frameBudget, NULL, GL_STREAM_DRAW);
+            mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, this->frameBudget,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (!mapped) {
+                std::cerr << "ERROR: could not map the texture upload buffer" << std::endl;
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                return;
+            }
+        }
+
+        // stage whole rows until the budget is spent
+        std::vector<Band> bands;
+        std::vector<Upload> completed;
+        GLsizeiptr used = 0;
+        while (!this->queue.empty()) {
+            Upload& upload = this->queue.front();
+            const Image::Level& level = upload.image.getLevel(upload.level);
+            bool compressed = upload.image.getCompression() != IMAGE_UNCOMPRESSED;
+            // texel rows per staged row
+            int rowHeight = compressed ? 4 : 1;
+            int levelRows = (level.height + rowHeight - 1) / rowHeight;
+            GLsizeiptr rowSize = (GLsizeiptr)(level.size / levelRows);
+            GLsizeiptr rows = (this->frameBudget - used) / rowSize;
+            if (rows > levelRows - upload.row)
+                rows = levelRows - upload.row;
+            if (rows == 0 && used == 0) {
+                // could never fit, the texture keeps undefined contents
+                std::cerr << "ERROR: texture rows of " << rowSize << " bytes exceed the upload budget" << std::endl;
+                this->queue.pop_front();
+                continue;
+            }
+            if (rows == 0)
+                break;
+
+            Band band;
+            band.texture = upload.texture;
+            band.format = upload.format;
+            band.level = upload.level;
+            band.row = upload.row * rowHeight;
+            band.width = level.width;
+            band.height = (GLsizei)(rows * rowHeight);
+            if (band.row + band.height > level.height)
+                band.height = level.height - band.row;
+            band.size = (GLsizei)(rows * rowSize);
+            band.compressed = compressed;
+            const unsigned char* source = upload.image.getLevelPixels(upload.level) + upload.row * rowSize;
+            if (mapped) {
+                band.offset = used;
+                memcpy(mapped + used, source, rows * rowSize);
+            } else {
+                band.offset = staging.write(source, rows * rowSize, 1);
+            }
+            used += rows * rowSize;
+
+            upload.row += (int)rows;
+            band.lastOfLevel = upload.row == levelRows;
+            bands.push_back(band);
+            if (!band.lastOfLevel)
+                continue;
+
+            upload.row = 0;
+            if (upload.level-- == 0) {
+                completed.push_back(std::move(upload));
+                this->queue.pop_front();
+            }
+        }
+
+        if (mapped)
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        else
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+
+        // rows are tightly packed, the copies read the buffer asynchronously
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (size_t i = 0; i < bands.size(); i++) {
+            const Band& band = bands[i];
+            RenderState::Get().bindTexture2D(0, band.texture);
+            if (band.compressed)
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, band.level, 0, band.row, band.width, band.height,
+                    band.format, band.size, (const void*)band.offset);
+            else
+                glTexSubImage2D(GL_TEXTURE_2D, band.level, 0, band.row, band.width, band.height,
+                    band.format, GL_UNSIGNED_BYTE, (const void*)band.offset);
+            if (band.lastOfLevel)
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, band.level);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        staging.endFrame();
+        this->uploadedBytes += (size_t)used;
+
+        for (size_t i = 0; i < completed.size(); i++) {
+            if (completed[i].generateMipmaps) {
+                RenderState::Get().bindTexture2D(0, completed[i].texture);
+                glGenerateMipmap(GL_TEXTURE_2D);
+            }
+        }
+        RenderState::Get().bindTexture2D(0, 0);
+
+        for (size_t i = 0; i < completed.size(); i++) {
+            if (completed[i].onComplete)
+                completed[i].onComplete(completed[i].texture);
+        }
+    }
+
+    void TextureUploader::finish()
+    {
+        while (!this->queue.empty() && isCreated()) {
+            size_t uploaded = this->uploadedBytes;
+            size_t pending = this->queue.size();
+            update();
+            // an unmappable buffer makes no progress
+            if (this->uploadedBytes == uploaded && this->queue.size() == pending)
+                break;
+        }
+    }
+
+    size_t TextureUploader::getPendingCount() const
+    {
+        return this->queue.size();
+    }
+
+    size_t TextureUploader::getUploadedBytes() const
+    {
+        return this->uploadedBytes;
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef TextureUploader_hpp
+#define TextureUploader_hpp
+
+#include "Image.hpp"
+#include "StreamBuffer.hpp"
+
+#include <GLEW/glew.h>
+
+#include <deque>
+#include <functional>
+
+namespace gps {
+
+    // Storage and sampling of a texture created by the uploader
+    struct TextureDesc {
+        // sized format, e.g. GL_SRGB8 or GL_RGBA8, block compressed images only keep whether it is sRGB
+        GLenum internalFormat;
+        GLenum wrap;
+    };
+
+    // Streams texture pixels to the GPU through a pixel unpack buffer, at most a
+    // frame budget of bytes per update(), so textures loaded mid-session never stall
+    // a frame on one big glTexImage2D. Textures get their storage when queued, immutable
+    // with GL 4.2 or ARB_texture_storage. Images carrying a mip chain upload it smallest
+    // level first and lower the base level as each finer level lands, others upload
+    // level 0 and build the chain with glGenerateMipmap once it is complete.
+    // Block compressed images upload as they are and keep the levels they bring.
+    class TextureUploader
+    {
+    public:
+        static const GLsizeiptr DEFAULT_FRAME_BUDGET = 4 * 1024 * 1024;
+
+        static bool HasImmutableStorage();
+        // Client format of 8-bit pixels with the given channel count
+        static GLenum PixelFormat(int channels);
+        // Sized format keeping the channel count, sRGB only exists for three and four
+        static GLenum ColorFormat(int channels, bool srgb);
+        // One and two channel images hold grey and grey with alpha, expands them on the
+        // bound GL_TEXTURE_2D so shaders read them as RGB(A)
+        static void SetGreySwizzle(int channels);
+        // BC1 and BC3 need EXT_texture_compression_s3tc and EXT_texture_sRGB, BC4 and BC5 GL 3.0
+        static bool SupportsCompression(ImageCompression compression);
+        static GLenum CompressedFormat(ImageCompression compression, bool srgb);
+
+        TextureUploader();
+        ~TextureUploader();
+        TextureUploader(const TextureUploader&) = delete;
+        TextureUploader& operator=(const TextureUploader&) = delete;
+
+        // The budget must hold at least one row of the widest level uploaded
+        bool Create(GLsizeiptr frameBudget = DEFAULT_FRAME_BUDGET);
+        // Drops queued uploads, their textures are left as they are
+        void Release();
+        bool isCreated() const;
+
+        // Creates the texture and queues the image, returns the texture at once.
+        // onComplete runs on the main thread, inside update(), after the last byte was issued.
+        GLuint enqueue(Image&& image, const TextureDesc& desc,
+            const std::function<void(GLuint)>& onComplete = std::function<void(GLuint)>());
+
+        // Issues up to the frame budget of queued pixels, call once per frame
+        void update();
+        // Issues everything queued, ignoring the budget
+        void finish();
+
+        size_t getPendingCount() const;
+        // Bytes issued since Create()
+        size_t getUploadedBytes() const;
+
+    private:
+        struct Upload {
+            GLuint texture;
+            Image image;
+            // pixel format, or the internal format of block compressed images
+            GLenum format;
+            // next level and row to copy, levels go from the last one down to 0, block
+            // compressed rows are rows of blocks
+            int level;
+            int row;
+            bool generateMipmaps;
+            std::function<void(GLuint)> onComplete;
+        };
+
+        // One band of rows staged in the unpack buffer
+        struct Band {
+            GLuint texture;
+            GLenum format;
+            GLint level;
+            GLint row;
+            GLsizei width;
+            GLsizei height;
+            GLintptr offset;
+            GLsizei size;
+            bool compressed;
+            bool lastOfLevel;
+        };
+
+        // persistently mapped staging when supported, ...
+        StreamBuffer staging;
+        // ... otherwise a buffer orphaned and mapped on every update
+        GLuint buffer;
+        GLsizeiptr frameBudget;
+        std::deque<Upload> queue;
+        size_t uploadedBytes;
+    };
+}
+
+#endif /* TextureUploader_hpp */
@@ -0,0 +1,71 @@
+#include "ThreadPool.hpp"
+
+namespace gps {
+
+    ThreadPool::ThreadPool()
+        : stopping(false)
+    {
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        Stop();
+    }
+
+    void ThreadPool::Start(unsigned workerCount)
+    {
+        Stop();
+        if (workerCount == 0) {
+            // hardware_concurrency() may report 0 when it cannot tell
+            unsigned hardwareThreads = std::thread::hardware_concurrency();
+            workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+
+        stopping = false;
+        for (unsigned i = 0; i < workerCount; i++)
+            workers.push_back(std::thread(&ThreadPool::run, this));
+    }
+
+    void ThreadPool::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            jobs.clear();
+        }
+        jobAvailable.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+        workers.clear();
+    }
+
+    void ThreadPool::submit(const std::function<void()>& job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+        }
+        jobAvailable.notify_one();
+    }
+
+    size_t ThreadPool::getWorkerCount() const
+    {
+        return workers.size();
+    }
+
+    void ThreadPool::run()
+    {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping)
+                    return;
+                job = jobs.front();
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    // Fixed set of worker threads running submitted jobs in FIFO order.
+    // Jobs must not touch GL, the context is only current on the main thread.
+    class ThreadPool
+    {
+    public:
+        ThreadPool();
+        ~ThreadPool();
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // 0 workers means one per hardware thread but the caller's
+        void Start(unsigned workerCount = 0);
+        // Drops the jobs that have not started and joins the workers
+        void Stop();
+
+        void submit(const std::function<void()>& job);
+        size_t getWorkerCount() const;
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()> > jobs;
+        std::mutex mutex;
+        std::condition_variable jobAvailable;
+        bool stopping;
+
+        void run();
+    };
+}
+
+#endif /* ThreadPool_hpp */
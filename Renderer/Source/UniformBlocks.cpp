@@ -0,0 +1,64 @@
+#include "UniformBlocks.hpp"
+
+#include "Shader.hpp"
+
+namespace gps {
+
+    static_assert(sizeof(CameraBlock) == 144, "CameraBlock must match the std140 layout");
+    static_assert(sizeof(LightBlock) == 128, "LightBlock must match the std140 layout");
+
+    void UniformBlocks::RegisterBindings()
+    {
+        Shader::setUniformBlockBinding("CameraBlock", CAMERA_BLOCK_BINDING);
+        Shader::setUniformBlockBinding("LightBlock", LIGHT_BLOCK_BINDING);
+    }
+
+    UniformBlocks::UniformBlocks()
+        : buffer(0), offsetAlignment(256)
+    {
+    }
+
+    UniformBlocks::~UniformBlocks()
+    {
+        Release();
+    }
+
+    void UniformBlocks::Create()
+    {
+        Release();
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &this->offsetAlignment);
+        glGenBuffers(1, &this->buffer);
+    }
+
+    void UniformBlocks::Release()
+    {
+        // an uncreated instance may outlive the GL context
+        if (this->buffer) {
+            glDeleteBuffers(1, &this->buffer);
+            this->buffer = 0;
+        }
+    }
+
+    void UniformBlocks::update(const CameraBlock& camera, const LightBlock& light, StreamBuffer* stream)
+    {
+        if (stream && stream->isCreated()) {
+            GLintptr cameraOffset = stream->write(&camera, sizeof(camera), this->offsetAlignment);
+            GLintptr lightOffset = stream->write(&light, sizeof(light), this->offsetAlignment);
+            if (cameraOffset >= 0 && lightOffset >= 0) {
+                glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, stream->getBuffer(), cameraOffset, sizeof(camera));
+                glBindBufferRange(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING, stream->getBuffer(), lightOffset, sizeof(light));
+                return;
+            }
+        }
+
+        // both blocks in one orphaned buffer, the light block at the first aligned offset
+        GLintptr lightOffset = (sizeof(camera) + this->offsetAlignment - 1) / this->offsetAlignment * this->offsetAlignment;
+        glBindBuffer(GL_UNIFORM_BUFFER, this->buffer);
+        glBufferData(GL_UNIFORM_BUFFER, lightOffset + sizeof(light), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(camera), &camera);
+        glBufferSubData(GL_UNIFORM_BUFFER, lightOffset, sizeof(light), &light);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, this->buffer, 0, sizeof(camera));
+        glBindBufferRange(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING, this->buffer, lightOffset, sizeof(light));
+    }
+}
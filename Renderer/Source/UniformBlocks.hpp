@@ -0,0 +1,66 @@
+#ifndef UniformBlocks_hpp
+#define UniformBlocks_hpp
+
+#include "StreamBuffer.hpp"
+
+#include <GLEW/glew.h>
+#include "glm/glm.hpp"
+
+namespace gps {
+
+    // Binding points of the blocks shared by the programs in Resource/Shader
+    enum UniformBlockBinding {
+        CAMERA_BLOCK_BINDING = 0,
+        LIGHT_BLOCK_BINDING = 1
+    };
+
+    // std140 mirror of `uniform CameraBlock`
+    struct CameraBlock
+    {
+        glm::mat4 projection;
+        glm::mat4 view;
+        glm::vec3 viewPos;
+        float padding;
+    };
+
+    // std140 mirror of `uniform LightBlock`, the attenuation floats pack behind lightColor
+    struct LightBlock
+    {
+        glm::mat4 lightSpaceMatrix;
+        glm::vec3 lightPos;
+        float padding0;
+        glm::vec3 lightDir;
+        float padding1;
+        glm::vec3 lightColor;
+        float constant;
+        float linear;
+        float quadratic;
+        float padding2[2];
+    };
+
+    // Camera and light state uploaded once per frame and bound for every program at once.
+    // With a created stream both blocks are written into its current region, otherwise
+    // into a buffer owned here.
+    class UniformBlocks
+    {
+    public:
+        // Registers the block binding points with gps::Shader, call before loading shaders
+        static void RegisterBindings();
+
+        UniformBlocks();
+        ~UniformBlocks();
+        UniformBlocks(const UniformBlocks&) = delete;
+        UniformBlocks& operator=(const UniformBlocks&) = delete;
+
+        void Create();
+        void Release();
+
+        void update(const CameraBlock& camera, const LightBlock& light, StreamBuffer* stream = NULL);
+
+    private:
+        GLuint buffer;
+        GLint offsetAlignment;
+    };
+}
+
+#endif /* UniformBlocks_hpp */
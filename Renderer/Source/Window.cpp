@@ -42,6 +42,61 @@ namespace gps {
         glfwGetFramebufferSize(window, &this->dimensions.width, &this->dimensions.height);
     }
 
+    void Window::CreateHeadless(int width, int height) {
+        if (!glfwInit()) {
+            throw std::runtime_error("Could not start GLFW3!");
+        }
+
+        //window hints
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        // nothing is presented, the scene is rendered into an FBO
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+        // prefer EGL (works with Mesa llvmpipe on GPU-less machines), fall back to the native API.
+        // The bundled GLEW is built for GLX/WGL and may fail to load on an EGL context,
+        // in which case that context is dropped as well.
+        const int contextApis[] = { GLFW_EGL_CONTEXT_API, GLFW_NATIVE_CONTEXT_API };
+        this->window = NULL;
+        for (size_t i = 0; i < sizeof(contextApis) / sizeof(contextApis[0]) && !this->window; i++) {
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, contextApis[i]);
+            this->window = glfwCreateWindow(width, height, "OpenGL Project Headless", NULL, NULL);
+            if (!this->window)
+                continue;
+
+            glfwMakeContextCurrent(window);
+
+            // start GLEW extension handler
+            glewExperimental = GL_TRUE;
+            GLenum glewResult = glewInit();
+            if (glewResult != GLEW_OK) {
+                std::cerr << "GLEW: " << glewGetErrorString(glewResult) << std::endl;
+                glfwMakeContextCurrent(NULL);
+                glfwDestroyWindow(this->window);
+                this->window = NULL;
+            }
+        }
+        if (!this->window) {
+            throw std::runtime_error("Could not create headless GLFW3 context!");
+        }
+
+        // never wait for vsync, frames are timed back to back
+        glfwSwapInterval(0);
+
+        // get version info
+        const GLubyte* renderer = glGetString(GL_RENDERER); // get renderer string
+        const GLubyte* version = glGetString(GL_VERSION); // version as a string
+        std::cout << "Renderer: " << renderer << std::endl;
+        std::cout << "OpenGL version: " << version << std::endl;
+
+        // the offscreen target has exactly the requested size
+        this->dimensions.width = width;
+        this->dimensions.height = height;
+    }
+
     void Window::Delete() {
         if (window)
             glfwDestroyWindow(window);
@@ -17,6 +17,8 @@ namespace gps {
 
     public:
         void Create(int width=800, int height=600, const char *title="OpenGL Project");
+        // Creates an invisible window whose context is only used for offscreen rendering
+        void CreateHeadless(int width=800, int height=600);
         void Delete();
 
         GLFWwindow* getWindow();
@@ -8,10 +8,26 @@
 #include <glm/gtc/type_ptr.hpp> //glm extension for accessing the internal data structure of glm types
 
 #include "Window.h"
+#include "AssetLoader.hpp"
 #include "Shader.hpp"
+#include "ShaderVariants.hpp"
 #include "Camera.hpp"
 #include "Model3D.hpp"
-
+#include "Benchmark.hpp"
+#include "Frustum.hpp"
+#include "MeshBatch.hpp"
+#include "RenderQueue.hpp"
+#include "RenderState.hpp"
+#include "Scene.hpp"
+#include "StreamBuffer.hpp"
+#include "TextureUploader.hpp"
+#include "UniformBlocks.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
 // window
@@ -19,10 +35,8 @@ gps::Window myWindow;
 
 
 // matrices
-glm::mat4 model;
 glm::mat4 view;
 glm::mat4 projection;
-glm::mat3 normalMatrix;
 
 // light parameters
 glm::vec3 lightDir;
@@ -31,18 +45,13 @@ glm::vec3 lightPosition;
 
 
 // shader uniform locations
-GLuint modelLoc;
-GLuint viewLoc;
-GLuint projectionLoc;
-GLuint normalMatrixLoc;
-GLuint lightDirLoc;
-GLuint lightColorLoc;
-GLuint lightPositionLoc;
-GLuint constant;
-GLuint linear;
-GLuint quadratic;
 GLuint shadowMap;
 
+// uniforms set every frame, interned once
+const gps::UniformId MODEL_UNIFORM = gps::Shader::uniformId("model");
+const gps::UniformId NORMAL_MATRIX_UNIFORM = gps::Shader::uniformId("normalMatrix");
+const gps::UniformId QUANTIZED_VERTICES_UNIFORM = gps::Shader::uniformId("quantizedVertices");
+
 // camera
 gps::Camera myCamera(
     glm::vec3(-2.0f, 8.0f, -1.0f),
@@ -60,14 +69,45 @@ gps::Model3D plane;
 gps::Model3D sphere;
 gps::Model3D monkey;
 
-GLfloat angle;
-GLfloat scale;
+// transforms of everything drawn from the models above
+gps::Scene sceneGraph;
+uint32_t teapotNode;
+// nodes Q/E and the benchmark turn around the y axis
+std::vector<uint32_t> spinningNodes;
+// the props are consecutive nodes, so their world matrices feed the instanced draw directly
+uint32_t firstPropNode;
 
 // shaders
-gps::Shader myBasicShader;
+// lighting variants B, N and M switch between, all compiled up front
+enum LightingMode {
+    LIGHTING_SOLID,
+    LIGHTING_DIRECTIONAL,
+    LIGHTING_POINT,
+    LIGHTING_MODE_COUNT
+};
+struct LightingVariant {
+    // permutation of the lighting uber-shader, unused by the solid mode which has a program of its own
+    gps::ShaderFeatures features;
+    // the solid variant keeps the current clear color
+    bool setsClearColor;
+    glm::vec3 clearColor;
+};
+const LightingVariant lightingVariants[LIGHTING_MODE_COUNT] = {
+    { 0, false, glm::vec3(0.0f) },
+    { gps::SHADER_QUANTIZED_VERTS, true, glm::vec3(0.7f) },
+    { gps::SHADER_POINT_LIGHT | gps::SHADER_QUANTIZED_VERTS, true, glm::vec3(0.0f) }
+};
+const gps::Shader* lightingShaders[LIGHTING_MODE_COUNT];
+LightingMode lightingMode = LIGHTING_DIRECTIONAL;
+gps::Shader solidShader;
 gps::Shader depthMapShader;
 gps::Shader debugDepthQuad;
-gps::Shader shader;
+// permutations of lighting.vs/lighting.fs
+gps::ShaderVariants sceneShaders;
+// the lit pass draws everything, instanced and quantized meshes included
+const gps::ShaderFeatures LIT_PASS_FEATURES = gps::SHADER_SHADOWS | gps::SHADER_FOG | gps::SHADER_POINT_LIGHT |
+    gps::SHADER_INSTANCED | gps::SHADER_QUANTIZED_VERTS;
+const gps::Shader* litShader = NULL;
 
 float deltaTime_in_miliSecs;
 float currentTimeStamp = 0;
@@ -96,6 +136,46 @@ unsigned int planeVAO;
 unsigned int quadVAO = 0;
 unsigned int quadVBO;
 
+unsigned int woodTexture;
+
+// models and textures decode on worker threads, the main loop uploads what has finished
+gps::AssetLoader assetLoader;
+// decoded textures reach the GPU a few megabytes per frame
+gps::TextureUploader textureUploader;
+bool sceneAssetsReady = false;
+double assetRequestTime = 0.0;
+
+// draws of the current frame, shared by the shadow and lit passes
+gps::RenderQueue sceneQueue;
+const unsigned SHADOW_PASS = 0;
+const unsigned LIT_PASS = 1;
+// per-frame instance and command data, written into persistently mapped memory
+gps::StreamBuffer frameStream;
+const GLsizeiptr STREAM_FRAME_SIZE = 4 * 1024 * 1024;
+// static scene meshes drawn with one multi-draw per pass, when the GL supports it
+gps::MeshBatch sceneBatch;
+// camera and light blocks shared by every program
+gps::UniformBlocks frameUniforms;
+
+// headless mode renders the lit pass into this FBO instead of the default framebuffer
+unsigned int sceneFBO = 0;
+unsigned int sceneColorRBO = 0;
+unsigned int sceneDepthRBO = 0;
+
+// command line options
+bool headless = false;
+int benchmarkFrames = 300;
+const int BENCHMARK_WARMUP_FRAMES = 10;
+const char* benchmarkOutput = NULL;
+// stdout as it was at startup, the benchmark JSON goes here when no output file is given
+std::streambuf* benchmarkStdout = NULL;
+std::vector<std::string> meshReportFiles;
+std::vector<std::string> cookTextureFiles;
+bool quantizedVertices = false;
+bool sceneBatching = true;
+bool streamUploads = true;
+int propCount = 0;
+
 GLenum glCheckError_(const char *file, int line)
 {
 	GLenum errorCode;
@@ -134,30 +214,35 @@ void windowResizeCallback(GLFWwindow* window, int width, int height) {
 	fprintf(stdout, "Window resized! New width: %d , and height: %d\n", width, height);
 	//TODO //DONE
 
-    glViewport(0, 0, width, height);
+    gps::RenderState::Get().viewport(0, 0, width, height);
     //glScissor(0, 0, width, height);
 
     /*WindowDimensions dims;
     dims.width = width;
     dims.height = height;*/
 
+    // the projection in CameraBlock picks up the new aspect ratio next frame
     myWindow.setWindowDimensions({width, height});
 
-    projection = glm::perspective(glm::radians(45.0f),
-        (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
-        0.1f, 40.0f);
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
     last_xpos = (double)width / 2;
     last_ypos = (double)height / 2;
     is_mouseCentered = true;
 }
 
+void selectLightingMode(LightingMode mode);
+
 void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int mode) {
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, GL_TRUE);
     }
 
+    // switch once per press, holding the key does not repeat it
+    if (action == GLFW_PRESS) {
+        if (key == GLFW_KEY_B) selectLightingMode(LIGHTING_SOLID);
+        if (key == GLFW_KEY_N) selectLightingMode(LIGHTING_DIRECTIONAL);
+        if (key == GLFW_KEY_M) selectLightingMode(LIGHTING_POINT);
+    }
+
 	if (key >= 0 && key < 1024) {
         if (action == GLFW_PRESS) {
             pressedKeys[key] = true;
@@ -190,125 +275,115 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
 
     myCamera.rotate(pitch, yaw);
 
-    myBasicShader.useShaderProgram(); //use default shader
     view = myCamera.getViewMatrix();
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
 }
 
-void initUniforms();
+// Picks the scene mesh under the screen center, the cursor is captured by the camera
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+    if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS)
+        return;
+
+    // the view matrix looks from the camera position at cameraTarget
+    glm::vec3 direction = glm::normalize(myCamera.cameraTarget - myCamera.cameraPosition);
+    float distance;
+    const gps::DrawItem* item = sceneQueue.pick(myCamera.cameraPosition, direction, 100.0f, distance);
+    if (item)
+        std::cout << "Picked mesh at (" << item->center.x << ", " << item->center.y << ", " << item->center.z
+            << "), distance " << distance << std::endl;
+}
+
+void spinScene(float degrees);
 
 void processMovement() {
 	if (pressedKeys[GLFW_KEY_W]) {
 		myCamera.move(gps::MOVE_FORWARD, cameraSpeed * deltaTime_in_miliSecs);
 		//update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        // compute normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
 
 	if (pressedKeys[GLFW_KEY_S]) {
 		myCamera.move(gps::MOVE_BACKWARD, cameraSpeed * deltaTime_in_miliSecs);
         //update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        // compute normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
 
 	if (pressedKeys[GLFW_KEY_A]) {
 		myCamera.move(gps::MOVE_LEFT, cameraSpeed * deltaTime_in_miliSecs);
         //update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        // compute normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
 
 	if (pressedKeys[GLFW_KEY_D]) {
 		myCamera.move(gps::MOVE_RIGHT, cameraSpeed * deltaTime_in_miliSecs);
         //update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        // compute normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
 
     if (pressedKeys[GLFW_KEY_Q]) {
-        angle -= 1.0f * deltaTime_in_miliSecs;
-        // update model matrix for teapot
-        model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
-        // update normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
+        spinScene(-1.0f * deltaTime_in_miliSecs);
     }
 
     if (pressedKeys[GLFW_KEY_E]) {
-        angle += 1.0f * deltaTime_in_miliSecs;
-        // update model matrix for teapot
-        model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
-        // update normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
+        spinScene(1.0f * deltaTime_in_miliSecs);
     }
 
-    if (pressedKeys[GLFW_KEY_T]) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    if (pressedKeys[GLFW_KEY_Y]) glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    if (pressedKeys[GLFW_KEY_U]) glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
+    if (pressedKeys[GLFW_KEY_T]) gps::RenderState::Get().polygonMode(GL_LINE);
+    if (pressedKeys[GLFW_KEY_Y]) gps::RenderState::Get().polygonMode(GL_FILL);
+    if (pressedKeys[GLFW_KEY_U]) gps::RenderState::Get().polygonMode(GL_POINT);
 
     if (pressedKeys[GLFW_KEY_O]) {
-        scale += 0.01 * deltaTime_in_miliSecs;
-
-        model = glm::scale(model, scale + glm::vec3(1.0f, 1.0f, 1.0f));
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
+        sceneGraph.setScale(teapotNode, sceneGraph.getScale(teapotNode) + glm::vec3(0.01f * deltaTime_in_miliSecs));
     }
 
     if (pressedKeys[GLFW_KEY_P]) {
-        scale -= 0.01 * deltaTime_in_miliSecs;
-
-        model = glm::scale(model, scale + glm::vec3(1.0f, 1.0f, 1.0f));
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
+        sceneGraph.setScale(teapotNode, sceneGraph.getScale(teapotNode) - glm::vec3(0.01f * deltaTime_in_miliSecs));
     }
+}
 
-    if (pressedKeys[GLFW_KEY_B]) {
-        myBasicShader.loadShader(
-            "Resource/Shader/solid_vert.shader",
-            "Resource/Shader/solid_frag.shader");
-
-        initUniforms();
-    }
-
-    if (pressedKeys[GLFW_KEY_N]) {
-        myBasicShader.loadShader(
-            "Resource/Shader/basic_vert_directional_light.shader",
-            "Resource/Shader/basic_frag_directional_light.shader");
-
-        glClearColor(0.7f, 0.7f, 0.7f, 1.0f);
-
-        initUniforms();
-    }
-
-    if (pressedKeys[GLFW_KEY_M]) {
-        myBasicShader.loadShader(
-            "Resource/Shader/basic_vert_point_light.shader",
-            "Resource/Shader/basic_frag_point_light.shader");
-
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-
-        initUniforms();
-    }
+// The variants were linked by initShaders() and keep their uniform values, so switching only swaps the program
+void selectLightingMode(LightingMode mode) {
+    lightingMode = mode;
+    const LightingVariant& variant = lightingVariants[mode];
+    if (variant.setsClearColor)
+        glClearColor(variant.clearColor.r, variant.clearColor.g, variant.clearColor.b, 1.0f);
+    lightingShaders[mode]->useShaderProgram();
 }
 
 void initOpenGLWindow() {
-    myWindow.Create(1024, 768, "OpenGL Project Core");
+    if (headless)
+        myWindow.CreateHeadless(1024, 768);
+    else
+        myWindow.Create(1024, 768, "OpenGL Project Core");
+}
+
+void initOffscreenTarget() {
+    int width = myWindow.getWindowDimensions().width;
+    int height = myWindow.getWindowDimensions().height;
+
+    glGenRenderbuffers(1, &sceneColorRBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, sceneColorRBO);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_SRGB8_ALPHA8, width, height);
+
+    glGenRenderbuffers(1, &sceneDepthRBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, sceneDepthRBO);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &sceneFBO);
+    gps::RenderState::Get().bindFramebuffer(sceneFBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, sceneColorRBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, sceneDepthRBO);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "ERROR: offscreen framebuffer is incomplete" << std::endl;
+    }
+    gps::RenderState::Get().bindFramebuffer(0);
 }
 
 void setWindowCallbacks() {
 	glfwSetWindowSizeCallback(myWindow.getWindow(), windowResizeCallback);
     glfwSetKeyCallback(myWindow.getWindow(), keyboardCallback);
     glfwSetCursorPosCallback(myWindow.getWindow(), mouseCallback);
+    glfwSetMouseButtonCallback(myWindow.getWindow(), mouseButtonCallback);
 
     /*hidden mouse cursor and doesn't let it leave the window*/
     glfwSetInputMode(myWindow.getWindow(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -317,7 +392,7 @@ void setWindowCallbacks() {
 
 void initOpenGLState() {
 	glClearColor(0.7f, 0.7f, 0.7f, 1.0f);
-	glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
+	gps::RenderState::Get().viewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
     glEnable(GL_FRAMEBUFFER_SRGB);
 	glEnable(GL_DEPTH_TEST); // enable depth-testing
  // depth-testing interprets a smaller value as "closer"
@@ -327,257 +402,202 @@ void initOpenGLState() {
 }
 
 void initModels() {
-    teapot.LoadModel("Resource/obj/teapot20segUT.obj");
-    cube.LoadModel("Resource/obj/cube.obj");
-    sphere.LoadModel("Resource/obj/sphere.obj");
-    monkey.LoadModel("Resource/obj/monkey.obj");
-    plane.LoadModel("Resource/obj/plane3.obj");
-}
-
-void initShaders() {
-    myBasicShader.loadShader(
-        "Resource/Shader/basic_vert_directional_light.shader",
-        "Resource/Shader/basic_frag_directional_light.shader");
-
-    depthMapShader.loadShader("Resource/Shader/simpleDepthShader.shader", "Resource/Shader/emptyfragmentshader.shader");
-    debugDepthQuad.loadShader("Resource/Shader/debug_quad.vs", "Resource/Shader/debug_quad_depth.fs");
-    shader.loadShader("Resource/Shader/shadow_mapping.vs", "Resource/Shader/shadow_mapping.fs");
-}
-
-void initUniforms() {
-	myBasicShader.useShaderProgram();
-
-    // create model matrix for teapot
-    model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-	modelLoc = glGetUniformLocation(myBasicShader.shaderProgram, "model");
-
-	// get view matrix for current camera
-	view = myCamera.getViewMatrix();
-	viewLoc = glGetUniformLocation(myBasicShader.shaderProgram, "view");
-	// send view matrix to shader
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-
-    // compute normal matrix for teapot
-    normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
-	normalMatrixLoc = glGetUniformLocation(myBasicShader.shaderProgram, "normalMatrix");
-
-	// create projection matrix
-	projection = glm::perspective(glm::radians(45.0f),
-                               (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
-                               0.1f, 40.0f);
-	projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-	// send projection matrix to shader
-	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));	
-
-	//set the light direction (direction towards the light)
-	lightDir = glm::vec3(2.0f, 2.0f, 2.0f);
-	lightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDir");
-	// send light dir to shader
-	glUniform3fv(lightDirLoc, 1, glm::value_ptr(lightDir));
-
-	//set light color
-	lightColor = glm::vec3(1.0f, 1.0f, 1.0f); //white light
-	lightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightColor");
-	// send light color to shader
-	glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
-
-    lightPosition = glm::vec3(-2.0f, 10.0f, -1.0f);
-    lightPositionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightPosition");
-    /*send light position to shader*/
-    glUniform3fv(lightPositionLoc, 1, glm::value_ptr(lightPosition));
-
-    constant = glGetUniformLocation(myBasicShader.shaderProgram, "constant");
-    glUniform1f(constant, 1.0f);
-
-    linear = glGetUniformLocation(myBasicShader.shaderProgram, "linear_");
-    glUniform1f(linear, 0.22f);
-
-    quadratic = glGetUniformLocation(myBasicShader.shaderProgram, "quadratic");
-    glUniform1f(quadratic, 0.20f);
-}
-
-void renderTeapotShader(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
+    if (quantizedVertices) {
+        teapot.SetVertexFormat(gps::VERTEX_FORMAT_QUANTIZED);
+        cube.SetVertexFormat(gps::VERTEX_FORMAT_QUANTIZED);
+        sphere.SetVertexFormat(gps::VERTEX_FORMAT_QUANTIZED);
+        monkey.SetVertexFormat(gps::VERTEX_FORMAT_QUANTIZED);
+        plane.SetVertexFormat(gps::VERTEX_FORMAT_QUANTIZED);
+    }
 
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    model = glm::scale(model, scale + glm::vec3(1.0f, 1.0f, 1.0f));
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-    shader.setMat4("model", model);
-    teapot.Draw(shader);
+    textureUploader.Create();
+    assetLoader.setTextureUploader(&textureUploader);
+    assetLoader.Start();
+    assetRequestTime = glfwGetTime();
+    assetLoader.LoadModel(teapot, "Resource/obj/teapot20segUT.obj");
+    assetLoader.LoadModel(cube, "Resource/obj/cube.obj");
+    assetLoader.LoadModel(sphere, "Resource/obj/sphere.obj");
+    assetLoader.LoadModel(monkey, "Resource/obj/monkey.obj");
+    assetLoader.LoadModel(plane, "Resource/obj/plane3.obj");
 }
 
-void renderPlaneShader(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
-    //model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-   // model = glm::scale(model, scale + glm::vec3(1.0f, 1.0f, 1.0f));
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-    shader.setMat4("model", model);
-  
-    // draw teapot
-    plane.Draw(shader);
+void initScene() {
+    teapotNode = sceneGraph.createNode(gps::Scene::NO_PARENT, &teapot);
+    sceneGraph.setPosition(teapotNode, glm::vec3(0.0f, 1.0f, 0.0f));
+    uint32_t node = sceneGraph.createNode(gps::Scene::NO_PARENT, &cube);
+    sceneGraph.setPosition(node, glm::vec3(3.0f, 1.0f, 0.0f));
+    spinningNodes.push_back(node);
+    node = sceneGraph.createNode(gps::Scene::NO_PARENT, &sphere);
+    sceneGraph.setPosition(node, glm::vec3(-3.0f, 1.0f, 2.0f));
+    spinningNodes.push_back(node);
+    node = sceneGraph.createNode(gps::Scene::NO_PARENT, &monkey);
+    sceneGraph.setPosition(node, glm::vec3(-3.0f, 1.0f, -2.0f));
+    spinningNodes.push_back(node);
+    spinningNodes.push_back(teapotNode);
+
+    // props: a square grid centered on the origin, resting on the floor, drawn
+    // instanced rather than through the queue so they carry no model
+    int side = (int)std::ceil(std::sqrt((float)propCount));
+    float spacing = 0.5f;
+    float origin = -0.5f * spacing * (side - 1);
+    firstPropNode = (uint32_t)sceneGraph.size();
+    for (int i = 0; i < propCount; i++) {
+        node = sceneGraph.createNode();
+        sceneGraph.setPosition(node, glm::vec3(origin + spacing * (i % side), -0.85f, origin + spacing * (i / side)));
+        sceneGraph.setRotation(node, glm::angleAxis(glm::radians(37.0f * i), glm::vec3(0.0f, 1.0f, 0.0f)));
+        sceneGraph.setScale(node, glm::vec3(0.15f));
+    }
 }
 
-void renderCubeShader(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(3.0f, 1.0f, 0.0f));
-    model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-    shader.setMat4("model", model);
-
-    // draw teapot
-    cube.Draw(shader);
+// Turns the spinning nodes around their y axis
+void spinScene(float degrees) {
+    glm::quat turn = glm::angleAxis(glm::radians(degrees), glm::vec3(0.0f, 1.0f, 0.0f));
+    for (size_t i = 0; i < spinningNodes.size(); i++) {
+        uint32_t node = spinningNodes[i];
+        sceneGraph.setRotation(node, glm::normalize(turn * sceneGraph.getRotation(node)));
+    }
 }
 
-void renderSphereShader(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(-3.0f, 1.0f, 2.0f));
-    model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-    shader.setMat4("model", model);
-  
-    // draw teapot
-    sphere.Draw(shader);
+void drawProps(const gps::Shader& shader) {
+    if (propCount > 0)
+        cube.DrawInstanced(shader, &sceneGraph.getWorldMatrix(firstPropNode), &sceneGraph.getNormalMatrix(firstPropNode),
+            propCount, &frameStream);
 }
 
-void renderMonkeyShader(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(-3.0f, 1.0f, -2.0f));
-    model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-    shader.setMat4("model", model);
-    //send teapot model matrix data to shader
-  
-    // draw teapot
-    monkey.Draw(shader);
+void initStreamBuffer() {
+    if (!streamUploads)
+        return;
+    if (!gps::StreamBuffer::IsSupported()) {
+        std::cout << "Persistent buffer mapping not supported, streaming with glBufferData" << std::endl;
+        return;
+    }
+    frameStream.Create(STREAM_FRAME_SIZE);
 }
 
-void renderTeapot(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-    model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    model = glm::scale(model, scale + glm::vec3(1.0f, 1.0f, 1.0f));
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-   
-    //send teapot model matrix data to shader
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-    //send teapot normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+void initSceneBatch() {
+    // the batch arena holds float vertices, --quantized keeps the per-mesh path it measures
+    if (!sceneBatching || quantizedVertices)
+        return;
+    if (!gps::MeshBatch::IsSupported()) {
+        std::cout << "Multi-draw indirect not supported, drawing meshes one by one" << std::endl;
+        return;
+    }
 
-    // draw teapot
-    teapot.Draw(shader);
+    std::vector<const gps::Model3D*> models;
+    models.push_back(&teapot);
+    models.push_back(&cube);
+    models.push_back(&sphere);
+    models.push_back(&monkey);
+    sceneBatch.Build(models, &frameStream);
 }
 
+// Uploads the assets that finished loading, the scene batch waits for all of them
+void updateAssets() {
+    assetLoader.update();
+    textureUploader.update();
+    if (sceneAssetsReady || assetLoader.getPendingCount() > 0 || textureUploader.getPendingCount() > 0)
+        return;
 
-void renderCube(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(3.0f, 0.0f, 0.0f));
-    model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-    //send teapot model matrix data to shader
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    
-    //send teapot normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-    // draw teapot
-    cube.Draw(shader);
+    sceneAssetsReady = true;
+    std::cout << "Assets ready after " << (glfwGetTime() - assetRequestTime) * 1000.0 << " ms" << std::endl;
+    initSceneBatch();
 }
 
-void renderSphere(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(-3.0f, 0.0f, 2.0f));
-    model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-    //send teapot model matrix data to shader
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-    //send teapot normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-    // draw teapot
-    sphere.Draw(shader);
+// Draws the sorted scene queue, batched when possible
+void submitSceneQueue(const gps::Shader& shader, bool bindTextures) {
+    if (sceneBatch.isBuilt())
+        sceneBatch.Submit(sceneQueue, shader, MODEL_UNIFORM, NORMAL_MATRIX_UNIFORM, bindTextures);
+    else
+        sceneQueue.submit(shader, MODEL_UNIFORM, NORMAL_MATRIX_UNIFORM);
 }
 
-void renderMonkey(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(-3.0f, 0.0f, -2.0f));
-    model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-    //send teapot model matrix data to shader
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-    //send teapot normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-    // draw teapot
-    monkey.Draw(shader);
+void initShaders() {
+    // programs pick up the block binding points when they are linked
+    gps::UniformBlocks::RegisterBindings();
+    frameUniforms.Create();
+
+    // every program is handed to the driver before any link status is read
+    gps::Shader::EnableParallelCompile();
+    solidShader.beginLoad("Resource/Shader/solid_vert.shader", "Resource/Shader/solid_frag.shader");
+    depthMapShader.beginLoad("Resource/Shader/simpleDepthShader.shader", "Resource/Shader/emptyfragmentshader.shader");
+    debugDepthQuad.beginLoad("Resource/Shader/debug_quad.vs", "Resource/Shader/debug_quad_depth.fs");
+
+    // the permutations in use are built ahead of time, others compile on first use
+    sceneShaders.setSources("Resource/Shader/lighting.vs", "Resource/Shader/lighting.fs");
+    std::vector<gps::ShaderFeatures> permutations;
+    permutations.push_back(LIT_PASS_FEATURES);
+    for (int mode = LIGHTING_DIRECTIONAL; mode < LIGHTING_MODE_COUNT; mode++)
+        permutations.push_back(lightingVariants[mode].features);
+    sceneShaders.prepare(permutations);
+
+    solidShader.finishLoad();
+    depthMapShader.finishLoad();
+    debugDepthQuad.finishLoad();
+
+    litShader = &sceneShaders.get(LIT_PASS_FEATURES);
+    lightingShaders[LIGHTING_SOLID] = &solidShader;
+    for (int mode = LIGHTING_DIRECTIONAL; mode < LIGHTING_MODE_COUNT; mode++)
+        lightingShaders[mode] = &sceneShaders.get(lightingVariants[mode].features);
 }
 
-void renderPlane(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
+void initUniforms() {
+	lightingShaders[lightingMode]->useShaderProgram();
 
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
-    //model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 
-    //send teapot model matrix data to shader
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	// get view matrix for current camera, the shaders read it from CameraBlock
+	view = myCamera.getViewMatrix();
 
-    //send teapot normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+	// projection, lights and attenuation reach the shaders through CameraBlock and LightBlock,
+	// see updateFrameUniforms()
 
-    // draw teapot
-    plane.Draw(shader);
-}
+	//set the light direction (direction towards the light)
+	lightDir = glm::vec3(2.0f, 2.0f, 2.0f);
 
-void renderScene() {
-	glClear(GL_COLOR_BUFFER_BIT /*| GL_DEPTH_BUFFER_BIT*/);
-    glClear(GL_STENCIL_BUFFER_BIT);
+	//set light color
+	lightColor = glm::vec3(1.0f, 1.0f, 1.0f); //white light
 
-	// render the teapot
-	renderTeapot(myBasicShader);
-    renderCube(myBasicShader);
-    renderSphere(myBasicShader);
-    renderMonkey(myBasicShader);
-    renderPlane(myBasicShader);
+    lightPosition = glm::vec3(-2.0f, 10.0f, -1.0f);
 }
 
 void cleanup() {
+    // no worker may still be filling a model that is about to be released
+    assetLoader.Stop();
+    textureUploader.Release();
+    // release the GL objects owned by the globals while the context still exists
+    sceneBatch.Release();
+    frameUniforms.Release();
+    frameStream.Release();
+    teapot = gps::Model3D();
+    cube = gps::Model3D();
+    plane = gps::Model3D();
+    sphere = gps::Model3D();
+    monkey = gps::Model3D();
+    solidShader = gps::Shader();
+    depthMapShader = gps::Shader();
+    debugDepthQuad = gps::Shader();
+    sceneShaders.Release();
+
+    if (sceneFBO) {
+        gps::RenderState::Get().onFramebufferDeleted(sceneFBO);
+        glDeleteFramebuffers(1, &sceneFBO);
+        glDeleteRenderbuffers(1, &sceneColorRBO);
+        glDeleteRenderbuffers(1, &sceneDepthRBO);
+    }
     myWindow.Delete();
     //cleanup code for your own data
 }
 
-void  renderScene(const gps::Shader& shader)
+// Collects this frame's objects once, the shadow and lit passes sort and draw the same list
+void collectScene()
 {
-    renderTeapotShader(shader);
-    renderCubeShader(shader);
-    renderSphereShader(shader);
-    renderMonkeyShader(shader);
-  
+    sceneGraph.updateWorldMatrices();
+
+    sceneQueue.clear();
+    for (uint32_t node = 0; node < sceneGraph.size(); node++) {
+        const gps::Model3D* model = sceneGraph.getModel(node);
+        if (model)
+            sceneQueue.add(*model, sceneGraph.getWorldMatrix(node), sceneGraph.getNormalMatrix(node));
+    }
 }
 
 void PlaneSetUp()
@@ -598,7 +618,7 @@ void PlaneSetUp()
     unsigned int planeVBO;
     glGenVertexArrays(1, &planeVAO);
     glGenBuffers(1, &planeVBO);
-    glBindVertexArray(planeVAO);
+    gps::RenderState::Get().bindVertexArray(planeVAO);
     glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), planeVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -607,7 +627,7 @@ void PlaneSetUp()
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glBindVertexArray(0);
+    gps::RenderState::Get().bindVertexArray(0);
 
 
 }
@@ -617,7 +637,7 @@ void shadowWork()
     glGenFramebuffers(1, &depthMapFBO);
    
     glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
+    gps::RenderState::Get().bindTexture2D(0, depthMap);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
         SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -628,56 +648,50 @@ void shadowWork()
     glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, boadercolor);
 
 
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+    gps::RenderState::Get().bindFramebuffer(depthMapFBO);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gps::RenderState::Get().bindFramebuffer(0);
 
     debugDepthQuad.useShaderProgram();
     debugDepthQuad.setInt("depthMap", 0);
-    shader.useShaderProgram();
-    shader.setInt("diffuseTexture", 0);
-    shader.setInt("shadowMap", 1);
+    litShader->useShaderProgram();
+    litShader->setInt("diffuseTexture", 0);
+    litShader->setInt("shadowMap", 1);
   
   
 }
 
-unsigned int loadTexture(char const* path)
+// texture shows one gray texel until the decoded file has been streamed into a texture of its own
+void loadTexture(char const* path, unsigned int& texture)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT); 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    unsigned int placeholder;
+    glGenTextures(1, &placeholder);
+
+    gps::RenderState::Get().bindTexture2D(0, placeholder);
+    const unsigned char gray[3] = { 128, 128, 128 };
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, gray);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    texture = placeholder;
+
+    unsigned int* target = &texture;
+    assetLoader.LoadImage(path, 0, true, [placeholder, target](gps::Image& image) {
+        if (!image.isLoaded())
+            return;
+        const gps::TextureDesc desc = {
+            gps::TextureUploader::ColorFormat(image.getChannels(), false),
+            (GLenum)(image.getChannels() == 4 ? GL_CLAMP_TO_EDGE : GL_REPEAT)
+        };
+        textureUploader.enqueue(std::move(image), desc, [placeholder, target](GLuint uploaded) {
+            gps::RenderState::Get().onTextureDeleted(placeholder);
+            glDeleteTextures(1, &placeholder);
+            *target = uploaded;
+        });
+    });
 }
 
 
@@ -685,8 +699,11 @@ void renderSceneShadow(const gps::Shader& shader)
 {
     // floor
     glm::mat4 model = glm::mat4(1.0f);
-    shader.setMat4("model", model);
-    glBindVertexArray(planeVAO);
+    shader.setMat4(MODEL_UNIFORM, model);
+    shader.setMat3(NORMAL_MATRIX_UNIFORM, glm::mat3(1.0f));
+    // the floor VAO always holds full float vertices
+    shader.setInt(QUANTIZED_VERTICES_UNIFORM, 0);
+    gps::RenderState::Get().bindVertexArray(planeVAO);
     glDrawArrays(GL_TRIANGLES, 0, 6);
     //Testing Cubes---------------------------------------------------------------------------------------------------------
     //// cubes
@@ -717,35 +734,261 @@ void LightWork()
         glm::vec3(0.0f, 1.0f, 0.0f));
 
     lightSpaceMatrix = lightProjection * lightView;
-
-    depthMapShader.useShaderProgram();
-    depthMapShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-
 }
 
 
 void PreRenderSetUp()
 {
 
-    glViewport(0, 0, (double)myWindow.getWindowDimensions().width, (double)myWindow.getWindowDimensions().height);
+    gps::RenderState::Get().viewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    shader.useShaderProgram();
+    litShader->useShaderProgram();
+}
+
+// Uploads the camera and light state every program reads, once per frame
+void updateFrameUniforms()
+{
+    LightWork();
+
+    gps::CameraBlock camera;
+    camera.projection = glm::perspective(glm::radians(myCamera.Zoom), (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height, 0.1f, 40.0f);
+    camera.view = myCamera.getViewMatrix();
+    // kept for the lit pass frustum
+    projection = camera.projection;
+    view = camera.view;
+    camera.viewPos = myCamera.cameraPosition;
+    camera.padding = 0.0f;
+
+    gps::LightBlock light;
+    light.lightSpaceMatrix = lightSpaceMatrix;
+    light.lightPos = lightPos;
+    light.padding0 = 0.0f;
+    light.lightDir = lightDir;
+    light.padding1 = 0.0f;
+    light.lightColor = lightColor;
+    light.constant = 1.0f;
+    light.linear = 0.22f;
+    light.quadratic = 0.20f;
+    light.padding2[0] = light.padding2[1] = 0.0f;
+
+    frameUniforms.update(camera, light, &frameStream);
+}
 
-    glm::mat4 Projection = glm::perspective(glm::radians(myCamera.Zoom), (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height, 0.1f, 40.0f);
-    glm::mat4 view = myCamera.getViewMatrix();
-    shader.setMat4("projection", Projection);
-    shader.setMat4("view", view);
-    shader.setVec3("viewPos", myCamera.cameraPosition.r, myCamera.cameraPosition.g, myCamera.cameraPosition.b);
-    shader.setVec3("lightPos", lightPos.r, lightPos.g, lightPos.b);
-    shader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-    
-    
 
+// DepthTexture Flling Rendering on Depth Texture
+void renderShadowPass()
+{
+    gps::RenderState::Get().viewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
+    gps::RenderState::Get().bindFramebuffer(depthMapFBO);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    // the shadow map must not stay bound to its sampler unit while it is being rendered into
+    gps::RenderState::Get().bindTexture2D(1, 0);
+    // meshes outside the light's ortho box cast no shadow into the map
+    gps::Frustum lightFrustum = gps::Frustum::FromMatrix(lightSpaceMatrix);
+    sceneQueue.sort(SHADOW_PASS, depthMapShader, lightView, &lightFrustum);
+    submitSceneQueue(depthMapShader, false);
+    drawProps(depthMapShader);
+    gps::RenderState::Get().bindFramebuffer(sceneFBO);
 }
 
+void renderLitPass()
+{
+    //   Testing Purpose//-------------------------------------------------------------------------------------------------------
+    //    glViewport(0, 0, (double)myWindow.getWindowDimensions().width, (double)myWindow.getWindowDimensions().height);
+    //glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    //debugDepthQuad.useShaderProgram();
+    //debugDepthQuad.setFloat("near_plane", near_plane);
+    //debugDepthQuad.setFloat("far_plane", far_plane);
+    //glActiveTexture(GL_TEXTURE0);
+    //glBindTexture(GL_TEXTURE_2D, depthMap);
+    //renderQuad();
+    //   Testing Purpose//-------------------------------------------------------------------------------------------------------
+    PreRenderSetUp();
+
+    gps::RenderState::Get().bindTexture2D(0, woodTexture);
+    gps::RenderState::Get().bindTexture2D(1, depthMap);
+    // Renders Plane for Depth Tex
+    renderSceneShadow(*litShader);
+    //Renders Pot Sphere Monkey
+    gps::Frustum cameraFrustum = gps::Frustum::FromMatrix(projection * view);
+    sceneQueue.sort(LIT_PASS, *litShader, view, &cameraFrustum);
+    submitSceneQueue(*litShader, true);
+    drawProps(*litShader);
+}
+
+// Renders a fixed number of frames offscreen and reports per-pass CPU/GPU times as JSON
+int runBenchmark()
+{
+    std::vector<std::string> passNames;
+    passNames.push_back("shadow");
+    passNames.push_back("lit");
+    gps::Benchmark benchmark(passNames, benchmarkFrames);
+
+    // fixed time step so every run animates the scene identically
+    deltaTime_in_miliSecs = 1000.0f / 60.0f / 20.0f;
+
+    for (int frame = 0; frame < BENCHMARK_WARMUP_FRAMES; frame++) {
+        frameStream.beginFrame();
+        collectScene();
+        updateFrameUniforms();
+        renderShadowPass();
+        renderLitPass();
+        frameStream.endFrame();
+    }
+    glFinish();
+    gps::RenderState::Get().resetStats();
+
+    // meshes each pass kept and culled, summed over the measured frames
+    double passVisible[2] = { 0.0, 0.0 };
+    double passCulled[2] = { 0.0, 0.0 };
+
+    while (!benchmark.isFinished()) {
+        benchmark.beginFrame();
+
+        spinScene(-1.0f * deltaTime_in_miliSecs);
+        frameStream.beginFrame();
+        collectScene();
+        updateFrameUniforms();
+
+        benchmark.beginPass(0);
+        renderShadowPass();
+        benchmark.endPass(0);
+        passVisible[0] += sceneQueue.getSortedCount();
+        passCulled[0] += sceneQueue.getCulledCount();
+
+        benchmark.beginPass(1);
+        renderLitPass();
+        benchmark.endPass(1);
+        passVisible[1] += sceneQueue.getSortedCount();
+        passCulled[1] += sceneQueue.getCulledCount();
+        frameStream.endFrame();
+
+        glFlush();
+        benchmark.endFrame();
+    }
+    glFinish();
+    glCheckError();
+
+    // GL state changes per frame that reached the driver and that the state cache dropped
+    const gps::RenderStateStats& stateStats = gps::RenderState::Get().getStats();
+    double frames = benchmark.getFrameCount();
+    for (int counter = 0; counter < gps::STATE_COUNTER_COUNT; counter++) {
+        std::string name = gps::RenderState::getCounterName((gps::RenderStateCounter)counter);
+        benchmark.addCounter(name + "_issued", stateStats.issued[counter] / frames);
+        benchmark.addCounter(name + "_elided", stateStats.elided[counter] / frames);
+    }
+    benchmark.addCounter("state_issued", stateStats.totalIssued() / frames);
+    benchmark.addCounter("state_elided", stateStats.totalElided() / frames);
+    benchmark.addCounter("stream_stalls", frameStream.getStallCount() / frames);
+    for (size_t pass = 0; pass < passNames.size(); pass++) {
+        benchmark.addCounter(passNames[pass] + "_visible", passVisible[pass] / frames);
+        benchmark.addCounter(passNames[pass] + "_culled", passCulled[pass] / frames);
+    }
+
+    std::string renderer = (const char*)glGetString(GL_RENDERER);
+    int width = myWindow.getWindowDimensions().width;
+    int height = myWindow.getWindowDimensions().height;
+
+    if (benchmarkOutput) {
+        std::ofstream out(benchmarkOutput);
+        if (!out) {
+            std::cerr << "ERROR: could not write " << benchmarkOutput << std::endl;
+            return EXIT_FAILURE;
+        }
+        benchmark.writeJSON(out, renderer, width, height);
+    } else {
+        std::ostream out(benchmarkStdout);
+        benchmark.writeJSON(out, renderer, width, height);
+        out.flush();
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void parseArguments(int argc, const char * argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            benchmarkFrames = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--benchmark-out") == 0 && i + 1 < argc) {
+            benchmarkOutput = argv[++i];
+        } else if (strcmp(argv[i], "--quantized") == 0) {
+            quantizedVertices = true;
+        } else if (strcmp(argv[i], "--props") == 0 && i + 1 < argc) {
+            propCount = std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--no-batching") == 0) {
+            sceneBatching = false;
+        } else if (strcmp(argv[i], "--no-stream") == 0) {
+            streamUploads = false;
+        } else if (strcmp(argv[i], "--mesh-report") == 0 && i + 1 < argc) {
+            meshReportFiles.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--cook-texture") == 0 && i + 1 < argc) {
+            cookTextureFiles.push_back(argv[++i]);
+        } else {
+            std::cerr << "Unknown argument: " << argv[i] << std::endl;
+            std::cerr << "Usage: " << argv[0] << " [--headless] [--frames N] [--benchmark-out file.json] [--quantized] [--no-batching] [--no-stream] [--props N] [--mesh-report file.obj]... [--cook-texture file.png]..." << std::endl;
+        }
+    }
+}
+
+// Parses the given models and prints ACMR/ATVR before and after optimization, no window needed
+int runMeshReport()
+{
+    for (size_t i = 0; i < meshReportFiles.size(); i++) {
+        const std::string& fileName = meshReportFiles[i];
+        std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+        std::vector<gps::MeshData> meshData;
+        std::vector<gps::VertexCacheStats> before, after;
+        if (!gps::Model3D::ReadOBJ(fileName, basePath, meshData, NULL, &before, &after)) {
+            std::cerr << "ERROR: could not parse " << fileName << std::endl;
+            return EXIT_FAILURE;
+        }
+        for (size_t s = 0; s < meshData.size(); s++) {
+            std::cout << "Shape " << s << " : " << meshData[s].indices.size() << " indices, "
+                << meshData[s].vertices.size() << " unique vertices" << std::endl;
+            std::cout << "  ACMR " << before[s].acmr << " -> " << after[s].acmr
+                << ", ATVR " << before[s].atvr << " -> " << after[s].atvr << std::endl;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+// Compresses the given images into texture caches next to them, no window needed
+int runTextureCooker()
+{
+    static const char* const COMPRESSION_NAMES[] = { "uncompressed", "BC1", "BC3", "BC4", "BC5" };
+    int result = EXIT_SUCCESS;
+    for (size_t i = 0; i < cookTextureFiles.size(); i++) {
+        const std::string& fileName = cookTextureFiles[i];
+        gps::Image cooked;
+        if (!gps::TextureCache::Cook(fileName, cooked)) {
+            std::cerr << "ERROR: could not cook " << fileName << std::endl;
+            result = EXIT_FAILURE;
+            continue;
+        }
+        size_t pixelBytes = (size_t)cooked.getWidth() * cooked.getHeight() * 4;
+        std::cout << gps::TextureCache::GetCachePath(fileName) << ": " << cooked.getWidth() << "x" << cooked.getHeight()
+            << " " << COMPRESSION_NAMES[cooked.getCompression()] << ", " << cooked.getLevelCount() << " levels, "
+            << cooked.getByteSize() << " bytes (" << pixelBytes << " bytes of RGBA8 level 0)" << std::endl;
+    }
+    return result;
+}
 
 int main(int argc, const char * argv[]) {
 
+    parseArguments(argc, argv);
+
+    if (!meshReportFiles.empty())
+        return runMeshReport();
+    if (!cookTextureFiles.empty())
+        return runTextureCooker();
+
+    // stdout carries nothing but the benchmark JSON, progress and driver info go to stderr
+    benchmarkStdout = std::cout.rdbuf();
+    if (headless && !benchmarkOutput)
+        std::cout.rdbuf(std::cerr.rdbuf());
+
     try {
         initOpenGLWindow();
     } catch (const std::exception& e) {
@@ -755,12 +998,27 @@ int main(int argc, const char * argv[]) {
 
     initOpenGLState();
 	initModels();
+	initStreamBuffer();
+	initScene();
 	initShaders();
 	initUniforms();
-    setWindowCallbacks();
+    if (headless)
+        initOffscreenTarget();
+    else
+        setWindowCallbacks();
     shadowWork();
-    unsigned int woodTexture = loadTexture(std::string("Resource/wood.png").c_str());
-  
+    loadTexture("Resource/wood.png", woodTexture);
+
+    if (headless) {
+        // measure complete frames only
+        assetLoader.finish();
+        textureUploader.finish();
+        updateAssets();
+        int result = runBenchmark();
+        cleanup();
+        return result;
+    }
+
     last_xpos = (double)myWindow.getWindowDimensions().width / 2;
     last_ypos = (double)myWindow.getWindowDimensions().height / 2;
     is_mouseCentered = true;
@@ -776,49 +1034,21 @@ int main(int argc, const char * argv[]) {
             // Presentation 
             myCamera.move(gps::MOVE_BACKWARD, cameraSpeed * deltaTime_in_miliSecs);
             myCamera.move(gps::MOVE_RIGHT, cameraSpeed * deltaTime_in_miliSecs);
-            angle -= 1.0f * deltaTime_in_miliSecs;
-            // update model matrix for teapot
-            model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
-            // update normal matrix for teapot
-            normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
+            spinScene(-1.0f * deltaTime_in_miliSecs);
         }
         else
         {
             processMovement();
 
         }
-        LightWork();
-    // DepthTexture Flling Rendering on Depth Texture
-      
-        glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
-        glBindTexture(GL_TEXTURE_2D, woodTexture);
-        renderScene(depthMapShader);    
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-
-    //   Testing Purpose//-------------------------------------------------------------------------------------------------------
-    //    glViewport(0, 0, (double)myWindow.getWindowDimensions().width, (double)myWindow.getWindowDimensions().height);
-    //glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    //debugDepthQuad.useShaderProgram();
-    //debugDepthQuad.setFloat("near_plane", near_plane);
-    //debugDepthQuad.setFloat("far_plane", far_plane);
-    //glActiveTexture(GL_TEXTURE0);
-    //glBindTexture(GL_TEXTURE_2D, depthMap);
-    //renderQuad();
-    //   Testing Purpose//-------------------------------------------------------------------------------------------------------
-        PreRenderSetUp();
-       
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, woodTexture);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, depthMap);
-        // Renders Plane for Depth Tex
-        renderSceneShadow(shader);
-        //Renders Pot Sphere Monkey
-        renderScene(shader);
 
+        updateAssets();
+        frameStream.beginFrame();
+        collectScene();
+        updateFrameUniforms();
+        renderShadowPass();
+        renderLitPass();
+        frameStream.endFrame();
 
 		glfwPollEvents();
 		glfwSwapBuffers(myWindow.getWindow());
@@ -848,7 +1078,7 @@ void renderQuad()
         // setup plane VAO
         glGenVertexArrays(1, &quadVAO);
         glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
+        gps::RenderState::Get().bindVertexArray(quadVAO);
         glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
@@ -856,9 +1086,8 @@ void renderQuad()
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     }
-    glBindVertexArray(quadVAO);
+    gps::RenderState::Get().bindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
 }
 
 //Not Using As this was for Testing Purpose
@@ -917,7 +1146,7 @@ void renderCube()
         glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
         // link vertex attributes
-        glBindVertexArray(cubeVAO);
+        gps::RenderState::Get().bindVertexArray(cubeVAO);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
@@ -925,10 +1154,8 @@ void renderCube()
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
     }
     // render Cube
-    glBindVertexArray(cubeVAO);
+    gps::RenderState::Get().bindVertexArray(cubeVAO);
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
 }
\ No newline at end of file